@@ -0,0 +1,102 @@
+#ifndef SATURN_COMMAND_BUFFER_HPP
+#define SATURN_COMMAND_BUFFER_HPP
+
+#include "ecs_core.hpp"
+#include "entity.hpp"
+
+namespace saturn {
+
+// Records structural changes so they can be made while a query is being iterated. Every system has its own buffer, so
+// recording never takes a lock, and the world applies them all at the end of the stage.
+class command_buffer {
+    friend class world;
+
+    enum class command_type : uint8_t {
+        create_entity,
+        destroy_entity,
+        set_component,
+        remove_component,
+    };
+
+    struct command {
+        command_type type;
+        component_id component;
+        // INVALID_ENTITY_ID for set commands that belong to the preceding create command
+        entity_id entity;
+        // Set commands own their component until it's applied, null for tags and once applied
+        void* data;
+    };
+
+    _::ecs_core* _core;
+    std::vector<command> _commands = {};
+    // Components are bump allocated from fixed size blocks which are kept between flushes
+    std::vector<void*> _blocks = {};
+    array_index _current_block = 0;
+    size_t _current_block_offset = 0;
+    // Components that don't fit in a block get their own allocation, freed on every flush
+    struct large_block {
+        void* data;
+        size_t size;
+        size_t alignment;
+    };
+    std::vector<large_block> _large_blocks = {};
+
+    explicit command_buffer(_::ecs_core* core) : _core(core) { }
+
+  public:
+    ~command_buffer();
+    command_buffer(const command_buffer&) = delete;
+    command_buffer& operator=(const command_buffer&) = delete;
+
+    template <typename... T>
+    void create_entity(T... components) {
+        _commands.push_back({command_type::create_entity, INVALID_COMPONENT_ID, INVALID_ENTITY_ID, nullptr});
+        (..., push_set_component(INVALID_ENTITY_ID, std::move(components)));
+    }
+
+    void destroy_entity(const entity& entity) {
+        _commands.push_back({command_type::destroy_entity, INVALID_COMPONENT_ID, entity.id(), nullptr});
+    }
+
+    // Adds the component or replaces the one the entity already has
+    template <typename T>
+    void set(const entity& entity, T component) {
+        push_set_component(entity.id(), std::move(component));
+    }
+
+    template <typename... T>
+    void remove(const entity& entity) {
+        (..., _commands.push_back(
+                  {command_type::remove_component, _core->lookup_component_id<T>(), entity.id(), nullptr}));
+    }
+
+    [[nodiscard]] bool empty() const {
+        return _commands.empty();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _commands.size();
+    }
+
+  private:
+    template <typename T>
+    void push_set_component(entity_id entity, T&& component) {
+        static_assert(!std::is_const_v<T>, "Can't set const components");
+        void* data = nullptr;
+        if constexpr (!_::is_tag_component_v<T>) {
+            data = allocate(sizeof(T), alignof(T));
+            new (data) T(std::move(component));
+        }
+        _commands.push_back({command_type::set_component, _core->lookup_component_id<T>(), entity, data});
+    }
+
+    void* allocate(size_t size, size_t alignment);
+    // Destroys every component that wasn't applied and gets the buffer ready to record again
+    void clear();
+    // Frees the blocks that aren't in use and the capacity of the command list
+    void shrink_to_fit();
+};
+
+} // namespace saturn
+
+#endif
@@ -5,6 +5,9 @@
 
 namespace saturn {
 
+// Handle to an entity's component. The component's location is cached and reused until the world next moves component
+// data, so repeated access is a version compare and a load. Caching mutates the handle, share copies of it between
+// threads rather than the handle itself.
 template <typename T>
 class component {
     friend class entity;
@@ -13,12 +16,44 @@ class component {
     entity_id _entity_id;
     _::ecs_core* _core;
 
+    T* _cached_component = nullptr;
+    _::archetype_storage* _cached_storage = nullptr;
+    array_index _cached_column = INVALID_ARRAY_INDEX;
+    array_index _cached_row = INVALID_ARRAY_INDEX;
+    uint64_t _cached_version = 0;
+
     component(component_id id, entity_id entity_id, _::ecs_core* core) : _id(id), _entity_id(entity_id), _core(core) { }
 
     [[nodiscard]] bool valid() const {
         return _core != nullptr && _entity_id != INVALID_ENTITY_ID && _core->entity_alive(_entity_id);
     }
 
+    T* resolve() {
+        if (!valid()) return nullptr;
+
+        if constexpr (_::is_sparse_component_v<T>) {
+            if (!_core->entity_has_sparse_component(_entity_id, _id)) return nullptr;
+            if constexpr (_::is_tag_component_v<T>) return &_::tag_component_instance<T>;
+            _cached_component = (T*) _core->find_sparse_set(_id)->find(_::entity_id_index(_entity_id));
+            _cached_version = _core->structural_version;
+            return _cached_component;
+        }
+
+        _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_entity_id)];
+        _::archetype& archetype = _core->archetypes[entity_archetype.archetype_index];
+        if (!_::archetype_mask_has_component(archetype.mask, _id)) return nullptr;
+        if constexpr (_::is_tag_component_v<T>) {
+            return &_::tag_component_instance<T>;
+        } else {
+            _cached_storage = &archetype.storage;
+            _cached_column = _::archetype_component_index(archetype, _id);
+            _cached_row = entity_archetype.archetype_entity_index;
+            _cached_component = (T*) _cached_storage->component(_cached_column, _cached_row);
+            _cached_version = _core->structural_version;
+            return _cached_component;
+        }
+    }
+
   public:
     [[nodiscard]] bool operator==(const component& other) const {
         return _id == other._id && _entity_id == other._entity_id && _core == other._core;
@@ -28,24 +63,25 @@ class component {
         return !(*this == other);
     }
 
-    [[nodiscard]] T* operator->() {
-        if (!valid()) throw std::runtime_error("Entity is dead");
+    // Null if the entity is dead or no longer has the component, never throws
+    [[nodiscard]] T* try_get() {
+        bool cached = _cached_component && _cached_version == _core->structural_version;
+        T* component = cached ? _cached_component : resolve();
+        // Handing out a mutable pointer counts as a write for change detection, sparse components aren't tracked
+        if constexpr (!std::is_const_v<T> && !_::is_tag_component_v<T> && !_::is_sparse_component_v<T>) {
+            if (component) _cached_storage->mark_changed(_cached_column, _cached_row, _core->tick);
+        }
+        return component;
+    }
 
-        _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_entity_id)];
-        _::archetype& archetype = _core->archetypes[entity_archetype.archetype_index];
-        if (_::archetype_mask_has_component(archetype.mask, _id))
-            return (T*) _core->entity_archetype_component(entity_archetype, _id);
-        else throw std::runtime_error("Component does not exist");
+    [[nodiscard]] T* operator->() {
+        T* component = try_get();
+        if (!component) throw std::runtime_error(valid() ? "Component does not exist" : "Entity is dead");
+        return component;
     }
 
     [[nodiscard]] T& operator*() {
-        if (!valid()) throw std::runtime_error("Entity is dead");
-
-        _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_entity_id)];
-        _::archetype& archetype = _core->archetypes[entity_archetype.archetype_index];
-        if (_::archetype_mask_has_component(archetype.mask, _id))
-            return *(T*) _core->entity_archetype_component(entity_archetype, _id);
-        else throw std::runtime_error("Component does not exist");
+        return *operator->();
     }
 };
 
@@ -0,0 +1,126 @@
+#ifndef SATURN_COMPONENT_REGISTRY_HPP
+#define SATURN_COMPONENT_REGISTRY_HPP
+
+#include "ecs_types.h"
+#include "utils/archetype_storage.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+
+namespace saturn {
+
+// Specialize as std::true_type to store T in a sparse set instead of in archetypes. Adding and removing T then never
+// moves the rest of the entity, which suits components that come and go often, but queries have to look it up per row.
+template <typename T>
+struct sparse_component : std::false_type { };
+
+namespace _ {
+
+template <typename T>
+constexpr bool is_sparse_component_v = sparse_component<std::remove_const_t<T>>::value;
+
+struct component_info {
+    // Zero for tag components, which only live in the archetype mask
+    size_t size;
+    size_t alignment;
+    component_relocate_func relocate;
+    component_destroy_func destroy;
+    // Sparse components live in a sparse set and are never part of an archetype mask
+    bool sparse;
+};
+
+template <typename T>
+void relocate_component(void* destination, void* source) {
+    new (destination) T(std::move(*(T*) source));
+    ((T*) source)->~T();
+}
+
+template <typename T>
+void destroy_component(void* component) {
+    ((T*) component)->~T();
+}
+
+// Empty types are tag components, they have no storage and every instance of one is interchangeable
+template <typename T>
+constexpr bool is_tag_component_v = std::is_empty_v<T>;
+
+template <typename T>
+std::remove_const_t<T> tag_component_instance = {};
+
+template <typename T>
+component_info create_component_info() {
+    using component_t = std::remove_const_t<T>;
+    constexpr bool sparse = is_sparse_component_v<T>;
+    if constexpr (is_tag_component_v<T>)
+        return {.size = 0, .alignment = 1, .relocate = nullptr, .destroy = nullptr, .sparse = sparse};
+
+    component_info info {
+        .size = sizeof(T), .alignment = alignof(T), .relocate = nullptr, .destroy = nullptr, .sparse = sparse};
+    if constexpr (!std::is_trivially_copyable_v<component_t> && std::is_move_constructible_v<component_t>)
+        info.relocate = relocate_component<component_t>;
+    if constexpr (!std::is_trivially_destructible_v<component_t>) info.destroy = destroy_component<component_t>;
+    return info;
+}
+
+// Process wide index for every type used as a component, registries map these to their own component ids
+type_index create_type_index();
+
+template <typename T>
+type_index lookup_type_index() {
+    static const type_index index = create_type_index();
+    return index;
+}
+
+} // namespace _
+
+// Assigns component ids to types. Ids are handed out in registration order, so registering components up front gives
+// every world that shares the registry the same deterministic ids. Looking up an already registered component is
+// lock-free and safe from any thread, registering a new one takes a lock once.
+class component_registry {
+    std::mutex _mutex;
+    std::unique_ptr<std::atomic<component_id>[]> _component_ids;
+    std::unique_ptr<_::component_info[]> _component_infos;
+    std::atomic<component_id> _component_count = 0;
+
+    component_registry();
+
+  public:
+    component_registry(const component_registry&) = delete;
+
+    static std::shared_ptr<component_registry> create() {
+        return std::shared_ptr<component_registry>(new component_registry());
+    }
+
+    template <typename T>
+    component_id id() {
+        using component_t = std::remove_const_t<T>;
+        _::type_index type = _::lookup_type_index<component_t>();
+        if (type < SATURN_ECS_MAX_COMPONENT_TYPES) {
+            component_id id = _component_ids[type].load(std::memory_order_acquire);
+            if (id != INVALID_COMPONENT_ID) return id;
+        }
+        return register_component(type, _::create_component_info<component_t>());
+    }
+
+    template <typename... T>
+    void register_components() {
+        (..., id<T>());
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _component_count.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] const _::component_info& info(component_id id) const {
+        return _component_infos[id];
+    }
+
+  private:
+    component_id register_component(_::type_index type, const _::component_info& info);
+};
+
+} // namespace saturn
+
+#endif
@@ -1,9 +1,12 @@
 #ifndef SATURN_ECS_H
 #define SATURN_ECS_H
 
+#include "command_buffer.hpp"
+#include "component_registry.hpp"
 #include "ecs_core.hpp"
 #include "ecs_types.h"
 #include "entity.hpp"
+#include "observer.hpp"
 #include "query.hpp"
 #include "universe.hpp"
 #include "world.hpp"
@@ -1,11 +1,23 @@
 #ifndef SATURN_ECS_CORE_HPP
 #define SATURN_ECS_CORE_HPP
 
+#include "component_registry.hpp"
 #include "ecs_types.h"
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include <result/result.h>
-#include <saturn/ecs/utils/component_pool.hpp>
+#include <saturn/ecs/utils/archetype_storage.hpp>
+#include <saturn/ecs/utils/sparse_set.hpp>
+#include <saturn/ecs/utils/thread_pool.hpp>
 
 // Hide this stuff from the user, they shouldn't need to use it
 namespace saturn::_ {
@@ -16,21 +28,64 @@ entity_id create_entity_id(array_index index, uint32_t version);
 
 uint32_t archetype_id_index(archetype_id id);
 archetype_id create_archetype_id(array_index index);
-archetype_component_id create_archetype_component_id(archetype_id archetype, component_id component);
 
 array_index component_id_bit_index(component_id id);
 component_id create_component_id(array_index bit_index);
 
-bool archetype_mask_matches(archetype_mask mask, archetype_mask other);
-bool archetype_mask_has_component(archetype_mask mask, component_id component);
-archetype_mask archetype_mask_add_component(archetype_mask mask, component_id component);
-archetype_mask archetype_mask_remove_component(archetype_mask mask, component_id component);
+bool archetype_mask_matches(const archetype_mask& mask, const archetype_mask& other);
+bool archetype_mask_intersects(const archetype_mask& mask, const archetype_mask& other);
+// Appends the index of every mask in masks that matches other and shares no component with exclude
+void archetype_masks_matching(const archetype_mask* masks, size_t count, const archetype_mask& other,
+                              const archetype_mask& exclude, std::vector<array_index>& matches);
+bool archetype_mask_has_component(const archetype_mask& mask, component_id component);
+array_index archetype_mask_component_rank(const archetype_mask& mask, component_id component);
+archetype_mask archetype_mask_add_component(const archetype_mask& mask, component_id component);
+archetype_mask archetype_mask_remove_component(const archetype_mask& mask, component_id component);
+
+// Process wide index for every type used as a resource, worlds keep their resources in a table indexed by it
+type_index create_resource_index();
+
+template <typename T>
+type_index lookup_resource_index() {
+    static const type_index index = create_resource_index();
+    return index;
+}
+
+template <typename F>
+void archetype_mask_for_each_component(const archetype_mask& mask, F&& func) {
+    for (array_index i = 0; i < SATURN_ECS_ARCHETYPE_MASK_WORDS; i++) {
+        uint64_t word = mask.words[i];
+        while (word) {
+            func(create_component_id(i * 64 + std::countr_zero(word)));
+            word &= word - 1;
+        }
+    }
+}
+
+struct archetype_transition {
+    array_index archetype_index = INVALID_ARRAY_INDEX;
+    // Pairs of (source component index, destination component index) for every component kept by the move
+    std::vector<std::pair<array_index, array_index>> component_indices = {};
+    // Source component indices for every component dropped by the move
+    std::vector<array_index> removed_component_indices = {};
+};
+
+struct archetype_edge {
+    archetype_transition add;
+    archetype_transition remove;
+};
 
 struct archetype {
     archetype_id id;
     archetype_mask mask;
-    std::vector<entity_id> entities;
-    std::vector<component_pool> component_pools;
+    table<entity_id> entities;
+    archetype_storage storage;
+    // Column index in storage for each component bit index, INVALID_ARRAY_INDEX if the component is missing or a tag
+    table<array_index> component_indices;
+    // Cached transitions to neighbouring archetypes, indexed by component bit index
+    std::vector<archetype_edge> edges;
+    // Cached transitions used by edits that change several components at once, keyed by the target mask
+    std::unordered_map<archetype_mask, archetype_transition> transitions;
 };
 
 struct entity_archetype {
@@ -38,24 +93,96 @@ struct entity_archetype {
     array_index archetype_entity_index;
 };
 
+struct hierarchy_node {
+    entity_id parent = INVALID_ENTITY_ID;
+    std::vector<entity_id> children = {};
+    // Level the entity is in and its index there, INVALID_ARRAY_INDEX for entities without a parent
+    array_index level = INVALID_ARRAY_INDEX;
+    array_index level_index = INVALID_ARRAY_INDEX;
+};
+
+// Column index in the archetype's storage, INVALID_ARRAY_INDEX if the component is missing or a tag
+inline array_index archetype_component_index(const archetype& archetype, component_id component) {
+    array_index bit_index = component_id_bit_index(component);
+    return bit_index < archetype.component_indices.size() ? archetype.component_indices[bit_index]
+                                                           : INVALID_ARRAY_INDEX;
+}
+
+struct query_cache_archetype {
+    array_index archetype_index;
+    // Component indices in the archetype, ordered by the component bit index in the query mask
+    std::vector<array_index> component_indices;
+};
+
+// Archetypes match a query filter if they have every component in include and none in exclude
+struct query_filter {
+    archetype_mask include;
+    archetype_mask exclude;
+
+    bool operator==(const query_filter& other) const = default;
+};
+
+struct query_filter_hash {
+    size_t operator()(const query_filter& filter) const noexcept;
+};
+
+struct query_cache {
+    query_filter filter;
+    std::vector<query_cache_archetype> archetypes;
+};
+
 struct ecs_core {
+    // Where component storage, entity tables and archetypes are allocated from. Declared first so it outlives them.
+    std::shared_ptr<allocator> memory;
+
     // Archetypes
-    std::vector<archetype> archetypes = {};
-    std::vector<std::vector<array_index>> archetype_free_entities = {};
+    table<archetype> archetypes = create_table<archetype>();
+    // Copy of every archetype's mask, kept contiguous so they can be matched against queries quickly
+    table<archetype_mask> archetype_masks = create_table<archetype_mask>();
     std::unordered_map<archetype_mask, archetype_id> archetypes_by_mask = {};
-    std::unordered_map<archetype_component_id, array_index> archetype_component_indices = {};
 
     // Entities
-    std::vector<entity_id> entities = {};
-    std::vector<array_index> free_entities = {};
-    std::vector<entity_archetype> entity_archetypes = {};
+    table<entity_id> entities = create_table<entity_id>();
+    table<array_index> free_entities = create_table<array_index>();
+    table<entity_archetype> entity_archetypes = create_table<entity_archetype>();
+
+    // Queries
+    std::vector<query_cache> query_caches = {};
+    std::unordered_map<query_filter, array_index, query_filter_hash> query_caches_by_filter = {};
 
     archetype_id empty_archetype_id = 0;
     array_index empty_archetype_index = 0;
-    static std::vector<size_t> component_sizes;
+    std::shared_ptr<component_registry> registry;
+    std::shared_ptr<thread_pool> workers;
+    // Queries started from concurrently running systems advance it, so it is atomic
+    std::atomic<world_tick> tick = 1;
+    // Bumped whenever component data can move, which invalidates the locations cached by component handles
+    uint64_t structural_version = 0;
+
+    // Sparse components, indexed by component bit index and created on first use
+    std::vector<std::unique_ptr<sparse_set>> sparse_sets = {};
+    // Components that have a sparse set, so destroying an entity only visits those
+    std::vector<component_id> sparse_components = {};
+
+    // Resources, indexed by resource index
+    std::vector<std::shared_ptr<void>> resources = {};
 
-    ecs_core() {
-        const auto empty_archetype_mask = 0;
+    // Hierarchy, indexed by entity index and only grown once an entity gets a parent
+    std::vector<hierarchy_node> hierarchy = {};
+    // Entities with a parent grouped by depth, the first level holds the children of entities without a parent
+    std::vector<std::vector<entity_id>> hierarchy_levels = {};
+
+    // Observers
+    bool has_observers = false;
+    // Components with an observer for each event, events are only recorded for these
+    std::array<archetype_mask, OBSERVER_EVENT_COUNT> observed_components = {};
+    // Entities each event happened to since the last delivery, indexed by event and then component bit index
+    std::array<std::vector<std::vector<entity_id>>, OBSERVER_EVENT_COUNT> observer_events = {};
+
+    ecs_core(std::shared_ptr<component_registry> registry, std::shared_ptr<thread_pool> workers,
+             std::shared_ptr<allocator> memory)
+        : memory(std::move(memory)), registry(std::move(registry)), workers(std::move(workers)) {
+        const auto empty_archetype_mask = archetype_mask {};
         auto& empty_archetype = get_or_create_archetype(empty_archetype_mask);
         empty_archetype_id = empty_archetype.id;
         empty_archetype_index = archetype_id_index(empty_archetype_id);
@@ -71,28 +198,28 @@ struct ecs_core {
         return next_system_id++;
     }
 
-    static component_id next_component_id;
+    static observer_id next_observer_id;
+    static observer_id create_observer_id() {
+        return next_observer_id++;
+    }
+
+    // An empty table that allocates from the world's allocator
     template <typename T>
-    std::enable_if_t<!std::is_const_v<T>, component_id> lookup_component_id() {
-        return lookup_component_id<const T>();
+    table<T> create_table() {
+        return table<T>(table_allocator<T>(memory.get()));
     }
 
     template <typename T>
-    std::enable_if_t<std::is_const_v<T>, component_id> lookup_component_id() {
-        static component_id id = 0;
-        static bool initialized = false;
-        if (initialized) return id;
-        else {
-            initialized = true;
-            component_sizes.push_back(sizeof(T));
-            return id = next_component_id++;
-        }
+    component_id lookup_component_id() {
+        return registry->id<T>();
     }
 
+    // Sparse components are left out, they never live in an archetype
     template <typename... T>
     archetype_mask create_archetype_mask() {
-        archetype_mask mask = 0;
-        (..., (mask = archetype_mask_add_component(mask, lookup_component_id<T>())));
+        archetype_mask mask = {};
+        (..., (is_sparse_component_v<T> ? void()
+                                         : void(mask = archetype_mask_add_component(mask, lookup_component_id<T>()))));
         return mask;
     }
 
@@ -101,84 +228,458 @@ struct ecs_core {
         return index < entities.size() && entities[index] == id;
     }
 
-    archetype& get_or_create_archetype(archetype_mask mask) {
+    archetype& get_or_create_archetype(const archetype_mask& mask) {
         auto it = archetypes_by_mask.find(mask);
         if (it != archetypes_by_mask.end()) return archetypes[it->second];
 
         archetype_id id = create_archetype_id(archetypes.size());
-        archetypes.push_back(archetype {.id = id, .mask = mask, .entities = {}, .component_pools = {}});
-        archetype_free_entities.emplace_back();
+        structural_version++;
+        archetypes.push_back(archetype {.id = id,
+                                        .mask = mask,
+                                        .entities = create_table<entity_id>(),
+                                        .storage = {},
+                                        .component_indices = create_table<array_index>(),
+                                        .edges = {},
+                                        .transitions = {}});
+        archetype_masks.push_back(mask);
         archetype& archetype = archetypes.back();
         archetypes_by_mask[mask] = id;
-        int archetype_component_index = 0;
-        for (int i = 0; i < SATURN_ECS_MAX_COMPONENTS; i++) {
-            if (!archetype_mask_has_component(archetype.mask, create_component_id(i))) continue;
-            component_id component_id = create_component_id(i);
-            archetype_component_id archetype_component_id = create_archetype_component_id(id, component_id);
-            archetype_component_indices[archetype_component_id] = archetype_component_index;
-            archetype.component_pools.emplace_back(component_id, component_sizes[i]);
-            archetype_component_index++;
+        std::vector<archetype_column> columns;
+        archetype_mask_for_each_component(mask, [&](component_id component) {
+            array_index i = component_id_bit_index(component);
+            const component_info& info = registry->info(component);
+            if (!info.size) return;
+            archetype.component_indices.resize(i + 1, INVALID_ARRAY_INDEX);
+            archetype.component_indices[i] = columns.size();
+            columns.push_back({.component = component,
+                               .component_size = info.size,
+                               .component_alignment = info.alignment,
+                               .relocate = info.relocate,
+                               .destroy = info.destroy,
+                               .offset = 0});
+        });
+        archetype.storage = archetype_storage(std::move(columns), memory.get());
+
+        for (auto& query_cache : query_caches) {
+            if (archetype_mask_matches(archetype.mask, query_cache.filter.include) &&
+                !archetype_mask_intersects(archetype.mask, query_cache.filter.exclude))
+                add_archetype_to_query_cache(query_cache, archetype);
         }
         return archetype;
     }
 
+    array_index get_or_create_query_cache(const query_filter& filter) {
+        auto it = query_caches_by_filter.find(filter);
+        if (it != query_caches_by_filter.end()) return it->second;
+
+        array_index index = query_caches.size();
+        query_caches.push_back(query_cache {.filter = filter, .archetypes = {}});
+        query_caches_by_filter[filter] = index;
+        query_cache& query_cache = query_caches.back();
+        std::vector<array_index> matching_archetypes;
+        archetype_masks_matching(archetype_masks.data(), archetype_masks.size(), filter.include, filter.exclude,
+                                 matching_archetypes);
+        for (array_index archetype_index : matching_archetypes)
+            add_archetype_to_query_cache(query_cache, archetypes[archetype_index]);
+        return index;
+    }
+
+    void add_archetype_to_query_cache(query_cache& query_cache, const archetype& archetype) {
+        query_cache_archetype cache_archetype {.archetype_index = archetype_id_index(archetype.id),
+                                               .component_indices = {}};
+        archetype_mask_for_each_component(query_cache.filter.include, [&](component_id component) {
+            cache_archetype.component_indices.push_back(archetype_component_index(archetype, component));
+        });
+        query_cache.archetypes.push_back(std::move(cache_archetype));
+    }
+
+    size_t archetype_entity_count(array_index archetype_index) const {
+        return archetypes[archetype_index].entities.size();
+    }
+
+    void mark_component_changed(entity_archetype& entity_archetype, component_id component) {
+        archetype& archetype = archetypes[entity_archetype.archetype_index];
+        array_index component_index = archetype_component_index(archetype, component);
+        if (component_index != INVALID_ARRAY_INDEX)
+            archetype.storage.mark_changed(component_index, entity_archetype.archetype_entity_index, tick);
+    }
+
+    void mark_component_added(entity_archetype& entity_archetype, component_id component) {
+        archetype& archetype = archetypes[entity_archetype.archetype_index];
+        array_index component_index = archetype_component_index(archetype, component);
+        if (component_index != INVALID_ARRAY_INDEX)
+            archetype.storage.mark_added(component_index, entity_archetype.archetype_entity_index, tick);
+    }
+
+    // Null if the world has no T
+    template <typename T>
+    T* find_resource() {
+        type_index index = lookup_resource_index<std::remove_const_t<T>>();
+        return index < resources.size() ? (T*) resources[index].get() : nullptr;
+    }
+
+    bool entity_in_hierarchy(entity_id entity) const {
+        array_index index = entity_id_index(entity);
+        return index < hierarchy.size() &&
+               (hierarchy[index].parent != INVALID_ENTITY_ID || !hierarchy[index].children.empty());
+    }
+
+    // True if ancestor is the entity itself or one of its ancestors
+    bool entity_descends_from(entity_id entity, entity_id ancestor) const {
+        while (entity != INVALID_ENTITY_ID) {
+            if (entity == ancestor) return true;
+            array_index index = entity_id_index(entity);
+            entity = index < hierarchy.size() ? hierarchy[index].parent : INVALID_ENTITY_ID;
+        }
+        return false;
+    }
+
+    void set_entity_parent(entity_id entity, entity_id parent) {
+        array_index index = entity_id_index(entity);
+        array_index parent_index = entity_id_index(parent);
+        if (hierarchy.size() <= std::max(index, parent_index)) hierarchy.resize(std::max(index, parent_index) + 1);
+        if (hierarchy[index].parent == parent) return;
+
+        if (hierarchy[index].parent != INVALID_ENTITY_ID) std::erase(entity_children(hierarchy[index].parent), entity);
+        hierarchy[index].parent = parent;
+        hierarchy[parent_index].children.push_back(entity);
+        array_index parent_level = hierarchy[parent_index].level;
+        set_hierarchy_level(entity, parent_level == INVALID_ARRAY_INDEX ? 0 : parent_level + 1);
+    }
+
+    void remove_entity_parent(entity_id entity) {
+        array_index index = entity_id_index(entity);
+        if (index >= hierarchy.size() || hierarchy[index].parent == INVALID_ENTITY_ID) return;
+
+        std::erase(entity_children(hierarchy[index].parent), entity);
+        hierarchy[index].parent = INVALID_ENTITY_ID;
+        set_hierarchy_level(entity, INVALID_ARRAY_INDEX);
+    }
+
+    // Detaches the entity from its parent and clears the hierarchy of its whole subtree, returning its descendants
+    std::vector<entity_id> remove_entity_hierarchy(entity_id entity) {
+        remove_entity_parent(entity);
+        std::vector<entity_id> descendants = std::move(entity_children(entity));
+        entity_children(entity).clear();
+        for (size_t i = 0; i < descendants.size(); i++) {
+            hierarchy_node& node = hierarchy[entity_id_index(descendants[i])];
+            remove_from_hierarchy_level(descendants[i]);
+            node.parent = INVALID_ENTITY_ID;
+            descendants.insert(descendants.end(), node.children.begin(), node.children.end());
+            node.children.clear();
+        }
+        return descendants;
+    }
+
+    std::vector<entity_id>& entity_children(entity_id entity) {
+        return hierarchy[entity_id_index(entity)].children;
+    }
+
+    // Moves the entity to the level and its descendants to the levels below it
+    void set_hierarchy_level(entity_id entity, array_index level) {
+        std::vector<std::pair<entity_id, array_index>> pending = {{entity, level}};
+        while (!pending.empty()) {
+            auto [current, current_level] = pending.back();
+            pending.pop_back();
+
+            hierarchy_node& node = hierarchy[entity_id_index(current)];
+            if (node.level == current_level) continue;
+            remove_from_hierarchy_level(current);
+            if (current_level != INVALID_ARRAY_INDEX) {
+                if (hierarchy_levels.size() <= current_level) hierarchy_levels.resize(current_level + 1);
+                node.level = current_level;
+                node.level_index = hierarchy_levels[current_level].size();
+                hierarchy_levels[current_level].push_back(current);
+            }
+
+            array_index child_level = current_level == INVALID_ARRAY_INDEX ? 0 : current_level + 1;
+            for (entity_id child : node.children)
+                pending.emplace_back(child, child_level);
+        }
+    }
+
+    void remove_from_hierarchy_level(entity_id entity) {
+        hierarchy_node& node = hierarchy[entity_id_index(entity)];
+        if (node.level == INVALID_ARRAY_INDEX) return;
+
+        auto& level = hierarchy_levels[node.level];
+        level[node.level_index] = level.back();
+        hierarchy[entity_id_index(level.back())].level_index = node.level_index;
+        level.pop_back();
+        node.level = INVALID_ARRAY_INDEX;
+        node.level_index = INVALID_ARRAY_INDEX;
+    }
+
+    // Orders the level by where its entities are stored, so walking it walks through archetype chunks in order
+    void sort_hierarchy_level(std::vector<entity_id>& level) {
+        auto by_storage = [&](entity_id a, entity_id b) {
+            const entity_archetype& a_archetype = entity_archetypes[entity_id_index(a)];
+            const entity_archetype& b_archetype = entity_archetypes[entity_id_index(b)];
+            return std::tie(a_archetype.archetype_index, a_archetype.archetype_entity_index) <
+                   std::tie(b_archetype.archetype_index, b_archetype.archetype_entity_index);
+        };
+        if (std::is_sorted(level.begin(), level.end(), by_storage)) return;
+
+        std::sort(level.begin(), level.end(), by_storage);
+        for (array_index i = 0; i < level.size(); i++)
+            hierarchy[entity_id_index(level[i])].level_index = i;
+    }
+
+    // Records the event for every observed component in components that isn't in except
+    void record_observer_event(observer_event event, entity_id entity, const archetype_mask& components,
+                               const archetype_mask& except) {
+        const archetype_mask& observed = observed_components[(size_t) event];
+        auto& events = observer_events[(size_t) event];
+        for (array_index i = 0; i < SATURN_ECS_ARCHETYPE_MASK_WORDS; i++) {
+            uint64_t word = components.words[i] & ~except.words[i] & observed.words[i];
+            while (word) {
+                events[i * 64 + std::countr_zero(word)].push_back(entity);
+                word &= word - 1;
+            }
+        }
+    }
+
+    // Releases the memory the archetype holds past its last entity, keeping up to spare_chunks chunks. Empty archetypes
+    // also drop their cached multi-component transitions, which are created again when an entity leaves them.
+    void compact_archetype(archetype& archetype, size_t spare_chunks) {
+        archetype.storage.shrink_to_fit(spare_chunks);
+        if (archetype.entities.capacity() > std::max(archetype.entities.size(), archetype.storage.capacity())) {
+            table<entity_id> entities(archetype.entities.get_allocator());
+            entities.reserve(std::max(archetype.entities.size(), archetype.storage.capacity()));
+            entities.insert(entities.end(), archetype.entities.begin(), archetype.entities.end());
+            archetype.entities = std::move(entities);
+        }
+        if (archetype.entities.empty()) archetype.transitions = {};
+    }
+
+    // Trims the entity, hierarchy and observer tables down to what they hold
+    void compact_tables() {
+        entities.shrink_to_fit();
+        free_entities.shrink_to_fit();
+        entity_archetypes.shrink_to_fit();
+
+        while (!hierarchy.empty() && hierarchy.back().parent == INVALID_ENTITY_ID && hierarchy.back().children.empty())
+            hierarchy.pop_back();
+        hierarchy.shrink_to_fit();
+        while (!hierarchy_levels.empty() && hierarchy_levels.back().empty())
+            hierarchy_levels.pop_back();
+        for (auto& level : hierarchy_levels)
+            level.shrink_to_fit();
+        hierarchy_levels.shrink_to_fit();
+
+        for (auto& events : observer_events) {
+            for (auto& entities : events)
+                entities.shrink_to_fit();
+        }
+    }
+
+    // Null if the component has no sparse set yet
+    sparse_set* find_sparse_set(component_id component) {
+        array_index bit_index = component_id_bit_index(component);
+        return bit_index < sparse_sets.size() ? sparse_sets[bit_index].get() : nullptr;
+    }
+
+    sparse_set& get_or_create_sparse_set(component_id component) {
+        if (sparse_set* set = find_sparse_set(component)) return *set;
+
+        array_index bit_index = component_id_bit_index(component);
+        if (sparse_sets.size() <= bit_index) sparse_sets.resize(bit_index + 1);
+        const component_info& info = registry->info(component);
+        sparse_sets[bit_index] =
+            std::make_unique<sparse_set>(info.size, info.alignment, info.relocate, info.destroy, memory.get());
+        sparse_components.push_back(component);
+        return *sparse_sets[bit_index];
+    }
+
+    bool entity_has_sparse_component(entity_id entity, component_id component) {
+        sparse_set* set = find_sparse_set(component);
+        return set && set->contains(entity_id_index(entity));
+    }
+
+    // Returns the new component uninitialized, the entity must not have it yet
+    void* add_sparse_component(entity_id entity, component_id component) {
+        if (has_observers) {
+            record_observer_event(observer_event::added, entity, archetype_mask_add_component({}, component), {});
+        }
+        return get_or_create_sparse_set(component).emplace(entity);
+    }
+
+    void remove_sparse_component(entity_id entity, component_id component) {
+        sparse_set* set = find_sparse_set(component);
+        if (!set || !set->contains(entity_id_index(entity))) return;
+        if (has_observers) {
+            record_observer_event(observer_event::removed, entity, archetype_mask_add_component({}, component), {});
+        }
+        set->erase(entity_id_index(entity));
+        // Erasing relocates another entity's component
+        structural_version++;
+    }
+
+    void destroy_entity_sparse_components(entity_id entity) {
+        for (component_id component : sparse_components) {
+            sparse_set& set = *find_sparse_set(component);
+            if (!set.contains(entity_id_index(entity))) continue;
+            if (has_observers) {
+                record_observer_event(observer_event::destroyed, entity, archetype_mask_add_component({}, component),
+                                      {});
+            }
+            set.erase(entity_id_index(entity));
+            structural_version++;
+        }
+    }
+
+    // The entity's component wherever it is stored, null if it doesn't have it or it is a tag
+    void* entity_component(entity_id entity, component_id component) {
+        if (registry->info(component).sparse) {
+            sparse_set* set = find_sparse_set(component);
+            return set ? set->find(entity_id_index(entity)) : nullptr;
+        }
+        return entity_archetype_component(entity_archetypes[entity_id_index(entity)], component);
+    }
+
     void* entity_archetype_component(entity_archetype& entity_archetype, component_id component) {
         archetype& archetype = archetypes[entity_archetype.archetype_index];
-        if (archetype.component_pools.empty()) return nullptr;
+        array_index bit_index = component_id_bit_index(component);
+        if (bit_index >= archetype.component_indices.size()) return nullptr;
 
-        archetype_component_id archetype_component_id = create_archetype_component_id(archetype.id, component);
-        auto it = archetype_component_indices.find(archetype_component_id);
-        if (it == archetype_component_indices.end()) return nullptr;
-        // TODO: Could do 2D array instead of map
-        return archetype.component_pools[it->second][entity_archetype.archetype_entity_index];
+        array_index component_index = archetype.component_indices[bit_index];
+        if (component_index == INVALID_ARRAY_INDEX) return nullptr;
+        return archetype.storage.component(component_index, entity_archetype.archetype_entity_index);
     }
 
-    void move_entity_to_archetype(entity_id entity, archetype& archetype) {
+    // Moves a component into uninitialized memory using the lifecycle it was registered with
+    void relocate_component_data(component_id component, void* destination, void* source) {
+        const component_info& info = registry->info(component);
+        if (info.relocate) info.relocate(destination, source);
+        else std::memcpy(destination, source, info.size);
+    }
+
+    void destroy_component_data(component_id component, void* data) {
+        const component_info& info = registry->info(component);
+        if (info.destroy) info.destroy(data);
+    }
+
+    archetype_edge& get_archetype_edge(array_index archetype_index, component_id component) {
+        auto& edges = archetypes[archetype_index].edges;
+        array_index bit_index = component_id_bit_index(component);
+        if (edges.size() <= bit_index) edges.resize(bit_index + 1);
+        return edges[bit_index];
+    }
+
+    archetype_transition create_archetype_transition(array_index from_archetype_index, array_index to_archetype_index) {
+        archetype_transition transition {
+            .archetype_index = to_archetype_index, .component_indices = {}, .removed_component_indices = {}};
+        const archetype& from_archetype = archetypes[from_archetype_index];
+        const archetype& to_archetype = archetypes[to_archetype_index];
+        for (array_index i = 0; i < from_archetype.storage.columns().size(); i++) {
+            component_id id = from_archetype.storage.column(i).component;
+            if (!archetype_mask_has_component(to_archetype.mask, id)) {
+                transition.removed_component_indices.push_back(i);
+                continue;
+            }
+            transition.component_indices.emplace_back(i, to_archetype.component_indices[component_id_bit_index(id)]);
+        }
+        return transition;
+    }
+
+    const archetype_transition& get_or_create_add_transition(array_index archetype_index, component_id component) {
+        if (get_archetype_edge(archetype_index, component).add.archetype_index != INVALID_ARRAY_INDEX)
+            return get_archetype_edge(archetype_index, component).add;
+
+        archetype_mask mask = archetype_mask_add_component(archetypes[archetype_index].mask, component);
+        array_index to_archetype_index = archetype_id_index(get_or_create_archetype(mask).id);
+        if (to_archetype_index != archetype_index) {
+            get_archetype_edge(to_archetype_index, component).remove =
+                create_archetype_transition(to_archetype_index, archetype_index);
+        }
+
+        auto& transition = get_archetype_edge(archetype_index, component).add;
+        return transition = create_archetype_transition(archetype_index, to_archetype_index);
+    }
+
+    const archetype_transition& get_or_create_remove_transition(array_index archetype_index, component_id component) {
+        if (get_archetype_edge(archetype_index, component).remove.archetype_index != INVALID_ARRAY_INDEX)
+            return get_archetype_edge(archetype_index, component).remove;
+
+        archetype_mask mask = archetype_mask_remove_component(archetypes[archetype_index].mask, component);
+        array_index to_archetype_index = archetype_id_index(get_or_create_archetype(mask).id);
+        if (to_archetype_index != archetype_index) {
+            get_archetype_edge(to_archetype_index, component).add =
+                create_archetype_transition(to_archetype_index, archetype_index);
+        }
+
+        auto& transition = get_archetype_edge(archetype_index, component).remove;
+        return transition = create_archetype_transition(archetype_index, to_archetype_index);
+    }
+
+    const archetype_transition& get_or_create_transition(array_index archetype_index, const archetype_mask& mask) {
+        auto it = archetypes[archetype_index].transitions.find(mask);
+        if (it != archetypes[archetype_index].transitions.end()) return it->second;
+
+        array_index to_archetype_index = archetype_id_index(get_or_create_archetype(mask).id);
+        return archetypes[archetype_index].transitions[mask] =
+                   create_archetype_transition(archetype_index, to_archetype_index);
+    }
+
+    void move_entity_to_archetype(entity_id entity, const archetype_transition& transition) {
         entity_archetype& entity_archetype = entity_archetypes[entity_id_index(entity)];
-        struct archetype& old_archetype = archetypes[entity_archetype.archetype_index];
-        if (old_archetype.id == archetype.id) return;
+        array_index old_archetype_index = entity_archetype.archetype_index;
+        if (old_archetype_index == transition.archetype_index) return;
 
-        array_index old_archetype_index = entity_archetype.archetype_entity_index;
-        remove_entity_from_archetype(entity);
-        add_entity_to_archetype(entity, archetype);
+        array_index old_archetype_entity_index = entity_archetype.archetype_entity_index;
+        archetype& new_archetype = archetypes[transition.archetype_index];
+        archetype& old_archetype = archetypes[old_archetype_index];
+        if (has_observers) {
+            record_observer_event(observer_event::added, entity, new_archetype.mask, old_archetype.mask);
+            record_observer_event(observer_event::removed, entity, old_archetype.mask, new_archetype.mask);
+        }
+        add_entity_to_archetype(entity, new_archetype);
 
-        for (int i = 0; i < old_archetype.component_pools.size(); i++) {
-            component_id id = old_archetype.component_pools[i].component_id();
-            void* new_component = entity_archetype_component(entity_archetype, id);
-            if (!new_component) continue; // If a component is being removed, then it won't be in the new archetype
-            std::memcpy(new_component, old_archetype.component_pools[i][old_archetype_index],
-                        component_sizes[component_id_bit_index(id)]);
+        for (auto [old_component_index, new_component_index] : transition.component_indices) {
+            new_archetype.storage.relocate_component(
+                new_component_index,
+                new_archetype.storage.component(new_component_index, entity_archetype.archetype_entity_index),
+                old_archetype.storage.component(old_component_index, old_archetype_entity_index));
+            new_archetype.storage.merge_ticks(new_component_index, entity_archetype.archetype_entity_index,
+                                              old_archetype.storage, old_component_index, old_archetype_entity_index);
         }
+        for (array_index old_component_index : transition.removed_component_indices)
+            old_archetype.storage.destroy_component(old_component_index, old_archetype_entity_index);
+
+        remove_archetype_entity(old_archetype, old_archetype_entity_index);
     }
 
     void remove_entity_from_archetype(entity_id entity) {
         entity_archetype& entity_archetype = entity_archetypes[entity_id_index(entity)];
-        archetype& archetype = archetypes[entity_archetype.archetype_index];
-
-        archetype_free_entities[archetype_id_index(archetype.id)].push_back(entity_archetype.archetype_entity_index);
-        archetype.entities[entity_archetype.archetype_entity_index] = INVALID_ENTITY_ID;
-        entity_archetype.archetype_index = -1;
-        entity_archetype.archetype_entity_index = -1;
+        archetypes[entity_archetype.archetype_index].storage.destroy_row(entity_archetype.archetype_entity_index);
+        remove_archetype_entity(archetypes[entity_archetype.archetype_index], entity_archetype.archetype_entity_index);
+        entity_archetype.archetype_index = INVALID_ARRAY_INDEX;
+        entity_archetype.archetype_entity_index = INVALID_ARRAY_INDEX;
     }
 
     void add_entity_to_archetype(entity_id entity, archetype& archetype) {
         entity_archetype& entity_archetype = entity_archetypes[entity_id_index(entity)];
         entity_archetype.archetype_index = archetype_id_index(archetype.id);
+        entity_archetype.archetype_entity_index = archetype.entities.size();
+        archetype.entities.push_back(entity);
+        archetype.storage.push_back();
+    }
 
-        auto& free_archetype_entities = archetype_free_entities[archetype_id_index(archetype.id)];
-        if (free_archetype_entities.empty()) {
-            entity_archetype.archetype_entity_index = archetype.entities.size();
-            archetype.entities.push_back(entity);
-            for (auto& pool : archetype.component_pools)
-                pool.push_back();
-        } else {
-            entity_archetype.archetype_entity_index = free_archetype_entities.back();
-            archetype.entities[entity_archetype.archetype_entity_index] = entity;
-            free_archetype_entities.pop_back();
+    // Keeps the archetype dense by moving its last entity into the removed slot, the removed entity's components must
+    // already have been destroyed or relocated
+    void remove_archetype_entity(archetype& archetype, array_index archetype_entity_index) {
+        structural_version++;
+        array_index last_archetype_entity_index = archetype.entities.size() - 1;
+        if (archetype_entity_index != last_archetype_entity_index) {
+            entity_id moved_entity = archetype.entities[last_archetype_entity_index];
+            archetype.entities[archetype_entity_index] = moved_entity;
+            entity_archetypes[entity_id_index(moved_entity)].archetype_entity_index = archetype_entity_index;
         }
+
+        archetype.entities.pop_back();
+        archetype.storage.swap_remove(archetype_entity_index);
     }
 };
 
 } // namespace saturn::_
-
 #endif
@@ -3,10 +3,12 @@
 
 #include <ratio>
 #include <cstdint>
+#include <functional>
 
 namespace saturn {
 
 class universe;
+class component_registry;
 class world;
 class entity;
 template <typename T>
@@ -24,14 +26,58 @@ typedef uint64_t entity_id;
 typedef uint16_t component_id;
 typedef uint32_t stage_id;
 typedef uint32_t system_id;
+typedef uint32_t observer_id;
+// Advances every world update and every time a query starts iterating, used to detect changed components
+typedef uint64_t world_tick;
+
+namespace _ {
+typedef uint32_t type_index;
+}
 
 const entity_id INVALID_ENTITY_ID = -1;
+const component_id INVALID_COMPONENT_ID = -1;
+const array_index INVALID_ARRAY_INDEX = -1;
+
+// What an observer is notified of. Removed is only recorded for entities that stay alive, the components of destroyed
+// entities are recorded as destroyed instead.
+enum class observer_event : uint8_t { added, removed, destroyed };
+const size_t OBSERVER_EVENT_COUNT = 3;
+
+// Can be overridden at compile time, must be a multiple of 64
+#ifndef SATURN_ECS_MAX_COMPONENTS
+#define SATURN_ECS_MAX_COMPONENTS 256
+#endif
+// The number of distinct types that can be used as components across every registry in the process
+#ifndef SATURN_ECS_MAX_COMPONENT_TYPES
+#define SATURN_ECS_MAX_COMPONENT_TYPES 4096
+#endif
+#define SATURN_ECS_ARCHETYPE_MASK_WORDS (SATURN_ECS_MAX_COMPONENTS / 64)
+static_assert(SATURN_ECS_MAX_COMPONENTS % 64 == 0, "SATURN_ECS_MAX_COMPONENTS must be a multiple of 64");
+
+#define SATURN_ECS_CHUNK_SIZE (16 * 1024)
+#define SATURN_ECS_COLUMN_ALIGNMENT 64
+#define SATURN_ECS_COMMAND_BLOCK_SIZE (4 * 1024)
+// Entities of a hierarchy level handed to a worker at a time when propagating values down the hierarchy
+#define SATURN_ECS_HIERARCHY_BATCH_SIZE 1024
+// Chunks an archetype keeps past its last entity when it's compacted during an update, so archetypes that shrink and
+// grow back don't reallocate on every update
+#define SATURN_ECS_COMPACTION_SPARE_CHUNKS 1
+// Size of a transparent huge page, and of the regions huge_page_allocator maps by default
+#define SATURN_ECS_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define SATURN_ECS_HUGE_PAGE_REGION_SIZE (32 * SATURN_ECS_HUGE_PAGE_SIZE)
 
-#define SATURN_ECS_MAX_COMPONENTS 64
-typedef uint64_t archetype_mask;
+struct archetype_mask {
+    uint64_t words[SATURN_ECS_ARCHETYPE_MASK_WORDS] = {};
+
+    bool operator==(const archetype_mask& other) const = default;
+};
 typedef uint32_t archetype_id;
-typedef uint64_t archetype_component_id;
 
 } // namespace saturn
 
+template <>
+struct std::hash<saturn::archetype_mask> {
+    size_t operator()(const saturn::archetype_mask& mask) const noexcept;
+};
+
 #endif
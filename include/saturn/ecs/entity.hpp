@@ -10,6 +10,8 @@ class entity {
     friend class world;
     template <typename... T>
     friend class query_iterator;
+    template <typename... T>
+    friend class query;
 
     entity_id _id;
     _::ecs_core* _core;
@@ -39,23 +41,70 @@ class entity {
         return _id != other._id;
     }
 
+    // A dead entity if it has no parent
+    [[nodiscard]] entity parent() const {
+        if (!alive() || !_core->entity_in_hierarchy(_id)) return {};
+        entity_id parent = _core->hierarchy[_::entity_id_index(_id)].parent;
+        return parent == INVALID_ENTITY_ID ? entity() : entity(parent, _core);
+    }
+
+    [[nodiscard]] std::vector<entity> children() const {
+        std::vector<entity> children;
+        if (!alive() || !_core->entity_in_hierarchy(_id)) return children;
+        for (entity_id child : _core->entity_children(_id))
+            children.push_back({child, _core});
+        return children;
+    }
+
+    // Makes the entity a child of parent, replacing its current parent. Destroying an entity destroys its children.
+    void set_parent(const entity& parent) {
+        if (!alive()) return;
+        if (!parent.alive() || parent._core != _core) throw std::runtime_error("Parent is dead");
+        if (_core->entity_descends_from(parent._id, _id))
+            throw std::runtime_error("Parent is the entity or one of its descendants");
+        _core->set_entity_parent(_id, parent._id);
+    }
+
+    void remove_parent() {
+        if (!alive()) return;
+        _core->remove_entity_parent(_id);
+    }
+
     // TODO: Return invalid component instead of result?
     template <typename T>
     [[nodiscard]] result::val<component<T>> get() const {
         if (!alive()) return result::err("Entity is dead");
+        if (!has<T>()) return result::err("Component does not exist");
+        return result::ok(component<T>(_core->lookup_component_id<T>(), _id, _core));
+    }
+
+    // Null if the entity is dead or doesn't have T. Unlike get() it never throws or allocates, for hot code.
+    template <typename T>
+    [[nodiscard]] T* try_get() const {
+        if (!alive()) return nullptr;
         component_id component_id = _core->lookup_component_id<T>();
+        if constexpr (_::is_sparse_component_v<T>) {
+            if (!_core->entity_has_sparse_component(_id, component_id)) return nullptr;
+            if constexpr (_::is_tag_component_v<T>) return &_::tag_component_instance<T>;
+            else return (T*) _core->find_sparse_set(component_id)->find(_::entity_id_index(_id));
+        }
+
         _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
         _::archetype& archetype = _core->archetypes[entity_archetype.archetype_index];
-        if (!_::archetype_mask_has_component(archetype.mask, component_id))
-            return result::err("Component does not exist");
-
-        return result::ok(component<T>(component_id, _id, _core));
+        if (!_::archetype_mask_has_component(archetype.mask, component_id)) return nullptr;
+        if constexpr (_::is_tag_component_v<T>) {
+            return &_::tag_component_instance<T>;
+        } else {
+            if constexpr (!std::is_const_v<T>) _core->mark_component_changed(entity_archetype, component_id);
+            return (T*) _core->entity_archetype_component(entity_archetype, component_id);
+        }
     }
 
     template <typename T>
     [[nodiscard]] bool has() const {
         if (!alive()) return false;
         component_id component_id = _core->lookup_component_id<T>();
+        if constexpr (_::is_sparse_component_v<T>) return _core->entity_has_sparse_component(_id, component_id);
         _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
         _::archetype& archetype = _core->archetypes[entity_archetype.archetype_index];
         return _::archetype_mask_has_component(archetype.mask, component_id);
@@ -67,15 +116,25 @@ class entity {
         if (!alive()) return result::err("Entity is dead");
 
         _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
-        _::archetype& old_archetype = _core->archetypes[entity_archetype.archetype_index];
 
         component_id component_id = _core->lookup_component_id<T>();
-        archetype_mask new_mask = _::archetype_mask_add_component(old_archetype.mask, component_id);
-        if (old_archetype.mask == new_mask) return result::err("Component already exists");
+        if constexpr (_::is_sparse_component_v<T>) {
+            if (_core->entity_has_sparse_component(_id, component_id)) return result::err("Component already exists");
+            void* component_ptr = _core->add_sparse_component(_id, component_id);
+            if constexpr (!_::is_tag_component_v<T>) new (component_ptr) T(std::forward<Args>(args)...);
+            return result::ok(component<T>(component_id, _id, _core));
+        }
+
+        auto& transition = _core->get_or_create_add_transition(entity_archetype.archetype_index, component_id);
+        if (transition.archetype_index == entity_archetype.archetype_index)
+            return result::err("Component already exists");
 
-        _core->move_entity_to_archetype(_id, _core->get_or_create_archetype(new_mask));
-        T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
-        new (component_ptr) T(std::forward<Args>(args)...);
+        _core->move_entity_to_archetype(_id, transition);
+        if constexpr (!_::is_tag_component_v<T>) {
+            T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
+            new (component_ptr) T(std::forward<Args>(args)...);
+            _core->mark_component_added(entity_archetype, component_id);
+        }
         return result::ok(component<T>(component_id, _id, _core));
     }
 
@@ -84,17 +143,25 @@ class entity {
         if (!alive()) return result::err("Entity is dead");
 
         _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
-        _::archetype& old_archetype = _core->archetypes[entity_archetype.archetype_index];
 
         component_id component_id = _core->lookup_component_id<T>();
-        archetype_mask new_mask = _::archetype_mask_add_component(old_archetype.mask, component_id);
-        if (old_archetype.mask != new_mask) {
-            _core->move_entity_to_archetype(_id, _core->get_or_create_archetype(new_mask));
-            T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
-            new (component_ptr) T(std::forward<T>(component));
-        } else {
+        if constexpr (_::is_sparse_component_v<T>) {
+            set_sparse_component<T>(component_id, std::forward<T>(component));
+            return result::ok(::saturn::component<T>(component_id, _id, _core));
+        }
+
+        auto& transition = _core->get_or_create_add_transition(entity_archetype.archetype_index, component_id);
+        if (transition.archetype_index != entity_archetype.archetype_index) {
+            _core->move_entity_to_archetype(_id, transition);
+            if constexpr (!_::is_tag_component_v<T>) {
+                T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
+                new (component_ptr) T(std::forward<T>(component));
+                _core->mark_component_added(entity_archetype, component_id);
+            }
+        } else if constexpr (!_::is_tag_component_v<T>) {
             T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
             *component_ptr = std::forward<T>(component);
+            _core->mark_component_changed(entity_archetype, component_id);
         }
 
         return result::ok(::saturn::component<T>(component_id, _id, _core));
@@ -110,13 +177,83 @@ class entity {
         if (!alive()) return;
 
         _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
-        _::archetype& old_archetype = _core->archetypes[entity_archetype.archetype_index];
 
         component_id component_id = _core->lookup_component_id<T>();
-        archetype_mask new_mask = _::archetype_mask_remove_component(old_archetype.mask, component_id);
-        if (old_archetype.mask == new_mask) return;
+        if constexpr (_::is_sparse_component_v<T>) {
+            _core->remove_sparse_component(_id, component_id);
+            return;
+        }
+
+        auto& transition = _core->get_or_create_remove_transition(entity_archetype.archetype_index, component_id);
+        _core->move_entity_to_archetype(_id, transition);
+    }
+
+    // Sets every component with a single archetype move
+    template <typename... T>
+    std::enable_if_t<(sizeof...(T) > 1), result::val<std::tuple<component<T>...>>> set(T... components) {
+        return remove_and_set<>(std::move(components)...);
+    }
+
+    // Removes every component with a single archetype move
+    template <typename... T>
+    std::enable_if_t<(sizeof...(T) > 1)> remove() {
+        if (!alive()) return;
+        remove_and_set<T...>();
+    }
+
+    // Removes the components R... and then sets the given components, moving the entity to its final archetype once.
+    // Sparse components are removed and set in place.
+    template <typename... R, typename... S>
+    result::val<std::tuple<component<S>...>> remove_and_set(S... components) {
+        static_assert((... && !std::is_const_v<S>), "Can't set const components");
+        if (!alive()) return result::err("Entity is dead");
+
+        _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(_id)];
+        archetype_mask old_mask = _core->archetypes[entity_archetype.archetype_index].mask;
+        archetype_mask new_mask = old_mask;
+        (..., (_::is_sparse_component_v<R>
+                   ? void()
+                   : void(new_mask = _::archetype_mask_remove_component(new_mask, _core->lookup_component_id<R>()))));
+        (..., (_::is_sparse_component_v<S>
+                   ? void()
+                   : void(new_mask = _::archetype_mask_add_component(new_mask, _core->lookup_component_id<S>()))));
 
-        _core->move_entity_to_archetype(_id, _core->get_or_create_archetype(new_mask));
+        auto& transition = _core->get_or_create_transition(entity_archetype.archetype_index, new_mask);
+        _core->move_entity_to_archetype(_id, transition);
+        (..., (_::is_sparse_component_v<R> ? _core->remove_sparse_component(_id, _core->lookup_component_id<R>())
+                                           : void()));
+        (..., set_moved_component<S>(entity_archetype, old_mask, std::move(components)));
+        return result::ok(std::tuple<component<S>...>(component<S>(_core->lookup_component_id<S>(), _id, _core)...));
+    }
+
+  private:
+    // Constructs the component if the entity just moved into an archetype with it, otherwise assigns it
+    template <typename T>
+    void set_moved_component(_::entity_archetype& entity_archetype, const archetype_mask& old_mask, T&& component) {
+        if constexpr (_::is_sparse_component_v<T>) {
+            set_sparse_component<T>(_core->lookup_component_id<T>(), std::forward<T>(component));
+        } else if constexpr (!_::is_tag_component_v<T>) {
+            component_id component_id = _core->lookup_component_id<T>();
+            T* component_ptr = (T*) _core->entity_archetype_component(entity_archetype, component_id);
+            if (_::archetype_mask_has_component(old_mask, component_id)) {
+                *component_ptr = std::forward<T>(component);
+                _core->mark_component_changed(entity_archetype, component_id);
+            } else {
+                new (component_ptr) T(std::forward<T>(component));
+                _core->mark_component_added(entity_archetype, component_id);
+            }
+        }
+    }
+
+    template <typename T>
+    void set_sparse_component(component_id component_id, T&& component) {
+        if (_core->entity_has_sparse_component(_id, component_id)) {
+            if constexpr (!_::is_tag_component_v<T>)
+                *(T*) _core->find_sparse_set(component_id)->find(_::entity_id_index(_id)) = std::forward<T>(component);
+        } else {
+            void* component_ptr = _core->add_sparse_component(_id, component_id);
+            if constexpr (!_::is_tag_component_v<T>) new (component_ptr) T(std::forward<T>(component));
+        }
     }
 };
 
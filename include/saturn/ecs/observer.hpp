@@ -0,0 +1,26 @@
+#ifndef SATURN_OBSERVER_HPP
+#define SATURN_OBSERVER_HPP
+
+#include "ecs_core.hpp"
+#include "entity.hpp"
+#include <span>
+
+namespace saturn {
+
+// Called with every entity the event happened to since the last delivery, in the order the events were recorded. The
+// world may have changed again since, an added component may already be gone and destroyed entities are dead.
+using observer_func = std::function<void(std::span<const entity> entities)>;
+
+namespace _ {
+
+struct observer {
+    component_id component;
+    observer_event event;
+    observer_func func;
+};
+
+} // namespace _
+
+} // namespace saturn
+
+#endif
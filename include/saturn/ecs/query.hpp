@@ -2,93 +2,404 @@
 #define SATURN_QUERY_HPP
 
 #include "ecs_core.hpp"
+#include <array>
+#include <span>
 
 namespace saturn {
 
-// TODO: Could cache which archetypes match the query and only iterate over those
+// Tag components have no storage, so queries hand them out by value instead of by reference
+template <typename T>
+using query_component_t = std::conditional_t<_::is_tag_component_v<T>, T, T&>;
+
+// Query filter for entities that have T, without fetching it
+template <typename T>
+struct with { };
+
+// Query filter for entities that don't have T
+template <typename T>
+struct without { };
+
+// Query filter for entities whose T may have been written to since the query last ran. Changes are tracked per chunk,
+// so this skips every chunk nobody wrote T in but can match rows in a written chunk whose T didn't change.
+template <typename T>
+struct changed { };
+
+// Query filter for entities that may have had T added since the query last ran, tracked per chunk like changed<T>
+template <typename T>
+struct added { };
+
+// Declares that a system reads the world's resource T, or writes it if T isn't const. Matches every entity and yields
+// nothing, the resource is fetched from the system context.
+template <typename T>
+struct resource { };
+
+// Declares that a system may touch anything in the world, such as making structural changes directly instead of
+// through its command buffers. Matches every entity and yields nothing, the system always runs alone.
+struct exclusive { };
+
+namespace _ {
+
+// How each query parameter matches archetypes and what it yields per row. T fetches a required component, T* an
+// optional one which is null when the entity doesn't have it, the filters yield nothing.
+template <typename T>
+struct query_term {
+    using component_t = T;
+    using result_t = std::tuple<query_component_t<T>>;
+    static constexpr bool required = true;
+    static constexpr bool excluded = false;
+    static constexpr bool fetched = true;
+    static constexpr bool optional = false;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = false;
+    static constexpr bool exclusive = false;
+};
+
+template <typename T>
+struct query_term<T*> {
+    using component_t = T;
+    using result_t = std::tuple<T*>;
+    static constexpr bool required = false;
+    static constexpr bool excluded = false;
+    static constexpr bool fetched = true;
+    static constexpr bool optional = true;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = false;
+    static constexpr bool exclusive = false;
+};
+
+template <typename T>
+struct query_term<with<T>> {
+    using component_t = const T;
+    using result_t = std::tuple<>;
+    static constexpr bool required = true;
+    static constexpr bool excluded = false;
+    static constexpr bool fetched = false;
+    static constexpr bool optional = false;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = false;
+    static constexpr bool exclusive = false;
+};
+
+template <typename T>
+struct query_term<without<T>> {
+    using component_t = const T;
+    using result_t = std::tuple<>;
+    static constexpr bool required = false;
+    static constexpr bool excluded = true;
+    static constexpr bool fetched = false;
+    static constexpr bool optional = false;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = false;
+    static constexpr bool exclusive = false;
+};
+
+template <typename T>
+struct query_term<changed<T>> : query_term<with<T>> {
+    static_assert(!is_tag_component_v<T>, "Tag components have no storage to track changes in");
+    static_assert(!is_sparse_component_v<T>, "Sparse components have no chunks to track changes in");
+    static constexpr bool changed_filter = true;
+};
+
+template <typename T>
+struct query_term<added<T>> : query_term<with<T>> {
+    static_assert(!is_tag_component_v<T>, "Tag components have no storage to track additions in");
+    static_assert(!is_sparse_component_v<T>, "Sparse components have no chunks to track additions in");
+    static constexpr bool added_filter = true;
+};
+
+template <typename T>
+struct query_term<resource<T>> {
+    using component_t = T;
+    using result_t = std::tuple<>;
+    static constexpr bool required = false;
+    static constexpr bool excluded = false;
+    static constexpr bool fetched = false;
+    static constexpr bool optional = false;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = true;
+    static constexpr bool exclusive = false;
+};
+
+template <>
+struct query_term<saturn::exclusive> {
+    using component_t = const saturn::exclusive;
+    using result_t = std::tuple<>;
+    static constexpr bool required = false;
+    static constexpr bool excluded = false;
+    static constexpr bool fetched = false;
+    static constexpr bool optional = false;
+    static constexpr bool changed_filter = false;
+    static constexpr bool added_filter = false;
+    static constexpr bool resource = false;
+    static constexpr bool exclusive = true;
+};
+
+// Resources and exclusive aren't components, so their terms have no component id
+template <typename T>
+component_id query_term_component_id(ecs_core* core) {
+    if constexpr (query_term<T>::resource || query_term<T>::exclusive) return INVALID_COMPONENT_ID;
+    else return core->lookup_component_id<typename query_term<T>::component_t>();
+}
+
+template <typename... T>
+constexpr bool query_has_chunk_filters_v = (... || (query_term<T>::changed_filter || query_term<T>::added_filter));
+
+// Sparse components aren't part of archetype masks, their terms are matched row by row against their sparse set
+template <typename T>
+constexpr bool query_term_sparse_v = !query_term<T>::resource && !query_term<T>::exclusive &&
+                                     is_sparse_component_v<typename query_term<T>::component_t>;
+
+template <typename... T>
+constexpr bool query_has_sparse_terms_v = (... || query_term_sparse_v<T>);
+
+template <typename... T>
+using query_result_t = decltype(std::tuple_cat(std::declval<std::tuple<const entity>>(),
+                                               std::declval<typename query_term<T>::result_t>()...));
+
+// Column of the term's component in the archetype, looked up once per archetype
+template <typename T>
+array_index query_term_column_index(const archetype& archetype, const query_cache_archetype& cache_archetype,
+                                    array_index rank, component_id component) {
+    using term = query_term<T>;
+    if constexpr (query_term_sparse_v<T>) return INVALID_ARRAY_INDEX;
+    else if constexpr (!term::fetched && !term::changed_filter && !term::added_filter) return INVALID_ARRAY_INDEX;
+    else if constexpr (term::optional) return archetype_component_index(archetype, component);
+    else return cache_archetype.component_indices[rank];
+}
+
+// Start of the term's column in the chunk, null for filters and missing components. Sparse terms get their sparse set
+// instead, which is null if nothing has the component yet.
+template <typename T>
+void* query_term_chunk(ecs_core* core, const archetype& archetype, array_index column_index, component_id component,
+                       array_index chunk) {
+    using component_t = typename query_term<T>::component_t;
+    if constexpr (query_term_sparse_v<T>) {
+        return core->find_sparse_set(component);
+    } else if constexpr (!query_term<T>::fetched) {
+        return nullptr;
+    } else if constexpr (is_tag_component_v<component_t>) {
+        if (!query_term<T>::optional || !archetype_mask_has_component(archetype.mask, component)) return nullptr;
+        return (void*) &tag_component_instance<component_t>;
+    } else {
+        return column_index == INVALID_ARRAY_INDEX ? nullptr : archetype.storage.chunk_column(chunk, column_index);
+    }
+}
+
+template <typename T>
+bool query_term_chunk_matches(const archetype& archetype, array_index column_index, array_index chunk,
+                              world_tick last_run_tick) {
+    if constexpr (query_term<T>::changed_filter)
+        return archetype.storage.chunk_changed_tick(chunk, column_index) > last_run_tick;
+    else if constexpr (query_term<T>::added_filter)
+        return archetype.storage.chunk_added_tick(chunk, column_index) > last_run_tick;
+    else return true;
+}
+
+// Fetching a mutable component counts as writing it, so the whole chunk is stamped when the query reaches it
+template <typename T>
+void query_term_mark_chunk(archetype& archetype, array_index column_index, array_index chunk, world_tick tick) {
+    using component_t = typename query_term<T>::component_t;
+    if constexpr (query_term<T>::fetched && !std::is_const_v<component_t> && !is_tag_component_v<component_t>) {
+        if (column_index != INVALID_ARRAY_INDEX) archetype.storage.mark_chunk_changed(chunk, column_index, tick);
+    }
+}
+
+template <typename T>
+typename query_term<T>::result_t query_term_sparse_result(sparse_set* set, entity_id entity) {
+    using term = query_term<T>;
+    using component_t = typename term::component_t;
+    if constexpr (term::optional && is_tag_component_v<component_t>) {
+        bool contains = set && set->contains(entity_id_index(entity));
+        return {contains ? &tag_component_instance<component_t> : nullptr};
+    } else if constexpr (term::optional) {
+        return {set ? (component_t*) set->find(entity_id_index(entity)) : nullptr};
+    } else if constexpr (is_tag_component_v<component_t>) {
+        return {component_t {}};
+    } else {
+        return {*(component_t*) set->find(entity_id_index(entity))};
+    }
+}
+
+// Whether the entity passes the term's sparse set, archetype terms are already matched by the query cache
+template <typename T>
+bool query_term_row_matches(void* column, entity_id entity) {
+    if constexpr (query_term_sparse_v<T>) {
+        bool contains = column && ((sparse_set*) column)->contains(entity_id_index(entity));
+        if constexpr (query_term<T>::required) return contains;
+        else if constexpr (query_term<T>::excluded) return !contains;
+    }
+    return true;
+}
+
+template <typename T>
+typename query_term<T>::result_t query_term_result(void* column, array_index row, entity_id entity) {
+    using term = query_term<T>;
+    using component_t = typename term::component_t;
+    if constexpr (!term::fetched) return {};
+    else if constexpr (query_term_sparse_v<T>) return query_term_sparse_result<T>((sparse_set*) column, entity);
+    else if constexpr (term::optional && is_tag_component_v<component_t>) return {(component_t*) column};
+    else if constexpr (term::optional) return {column ? (component_t*) column + row : nullptr};
+    else if constexpr (is_tag_component_v<component_t>) return {component_t {}};
+    else return {((component_t*) column)[row]};
+}
+
+} // namespace _
+
 template <typename... T>
 class query_iterator {
     using iterator_concept [[maybe_unused]] = std::forward_iterator_tag;
-    using value_type = std::tuple<const entity, T&...>;
+    using value_type = _::query_result_t<T...>;
 
     _::ecs_core* _core;
-    archetype_mask _mask;
-
-    array_index _current_archetype_index;
+    array_index _cache_index;
+    std::array<array_index, sizeof...(T)> _component_ranks;
+    std::array<component_id, sizeof...(T)> _component_ids;
+    // changed<T> and added<T> match chunks stamped after the last run, chunks this run writes are stamped with run tick
+    world_tick _last_run_tick;
+    world_tick _run_tick;
+
+    array_index _current_cache_archetype_index;
     array_index _current_entity_index;
+    size_t _current_archetype_entity_count = 0;
+    const entity_id* _current_archetype_entities = nullptr;
+
+    array_index _current_chunk_index = 0;
+    array_index _current_chunk_row = 0;
+    size_t _current_chunk_row_count = 0;
 
-    array_index _component_indices[sizeof...(T)];
+    std::array<array_index, sizeof...(T)> _component_indices;
+    std::array<void*, sizeof...(T)> _chunk_components;
 
-    query_iterator(_::ecs_core* core, archetype_mask mask, size_t archetype_index, size_t entity_index)
+    query_iterator(_::ecs_core* core, array_index cache_index,
+                   const std::array<array_index, sizeof...(T)>& component_ranks,
+                   const std::array<component_id, sizeof...(T)>& component_ids, world_tick last_run_tick,
+                   world_tick run_tick, size_t cache_archetype_index, size_t entity_index)
         : _core(core),
-          _mask(mask),
-          _current_archetype_index(archetype_index),
+          _cache_index(cache_index),
+          _component_ranks(component_ranks),
+          _component_ids(component_ids),
+          _last_run_tick(last_run_tick),
+          _run_tick(run_tick),
+          _current_cache_archetype_index(cache_archetype_index),
           _current_entity_index(entity_index),
-          _component_indices() { }
+          _component_indices(),
+          _chunk_components() { }
 
     template <size_t... I>
     void advance_to_next_archetype(std::index_sequence<I...>) {
-        while (_current_archetype_index == -1 || _current_archetype_index < _core->archetypes.size()) {
-            _current_archetype_index++;
-            _current_entity_index = -1;
+        const auto& cache = _core->query_caches[_cache_index];
+        // Starts from -1, which wraps around to the first archetype
+        while (++_current_cache_archetype_index < cache.archetypes.size()) {
+            // Skip this archetype if it has no entities
+            const auto& cache_archetype = cache.archetypes[_current_cache_archetype_index];
+            const auto& current_archetype = _core->archetypes[cache_archetype.archetype_index];
+            _current_archetype_entity_count = current_archetype.entities.size();
+            if (!_current_archetype_entity_count) continue;
+
+            _current_archetype_entities = current_archetype.entities.data();
+            ((_component_indices[I] = _::query_term_column_index<T>(current_archetype, cache_archetype,
+                                                                     _component_ranks[I], _component_ids[I])),
+             ...);
+            _current_entity_index = 0;
+            _current_chunk_index = 0;
+            if (seek_matching_chunk(std::index_sequence_for<T...>())) return;
+        }
+        _current_entity_index = -1;
+    }
 
-            if (_current_archetype_index >= _core->archetypes.size()) return;
+    // Loads the first chunk from the current one on that passes the chunk filters, false if the archetype has none left
+    template <size_t... I>
+    bool seek_matching_chunk(std::index_sequence<I...>) {
+        auto& archetype = current_archetype();
+        while (_current_entity_index < _current_archetype_entity_count) {
+            if ((... && _::query_term_chunk_matches<T>(archetype, _component_indices[I], _current_chunk_index,
+                                                       _last_run_tick))) {
+                load_current_chunk(std::index_sequence_for<T...>());
+                return true;
+            }
+            _current_entity_index += archetype.storage.chunk_row_count(_current_chunk_index);
+            _current_chunk_index++;
+        }
+        return false;
+    }
 
-            const auto& current_archetype = _core->archetypes[_current_archetype_index];
-            if (_::archetype_mask_matches(current_archetype.mask, _mask)) {
-                auto entity_count = current_archetype.entities.size();
+    template <size_t... I>
+    void load_current_chunk(std::index_sequence<I...>) {
+        auto& archetype = current_archetype();
+        _current_chunk_row = 0;
+        _current_chunk_row_count = archetype.storage.chunk_row_count(_current_chunk_index);
+        ((_chunk_components[I] = _::query_term_chunk<T>(_core, archetype, _component_indices[I], _component_ids[I],
+                                                         _current_chunk_index)),
+         ...);
+        (..., _::query_term_mark_chunk<T>(archetype, _component_indices[I], _current_chunk_index, _run_tick));
+    }
 
-                // Skip this archetype if it has no entities
-                if (!entity_count) continue;
+    _::archetype& current_archetype() {
+        const auto& cache = _core->query_caches[_cache_index];
+        return _core->archetypes[cache.archetypes[_current_cache_archetype_index].archetype_index];
+    }
 
-                // Skip this archetype if all it's entities are dead
-                if (_core->archetype_free_entities[_current_archetype_index].size() == entity_count) continue;
+    void advance_to_next_row() {
+        _current_entity_index++;
+        if (++_current_chunk_row < _current_chunk_row_count) return;
 
-                ((_component_indices[I] = _core->archetype_component_indices[_::create_archetype_component_id(
-                      current_archetype.id, _core->lookup_component_id<T>())]),
-                 ...);
-                return;
-            }
-        }
+        _current_chunk_index++;
+        if (!seek_matching_chunk(std::index_sequence_for<T...>()))
+            advance_to_next_archetype(std::index_sequence_for<T...>());
     }
 
-    void advance_to_next_alive_entity() {
-        while (_current_archetype_index < _core->archetypes.size()) {
-            _current_entity_index++;
-
-            const auto& current_archetype = _core->archetypes[_current_archetype_index];
-            if (_current_entity_index >= current_archetype.entities.size()) {
-                advance_to_next_archetype(std::index_sequence_for<T...>());
-                continue;
-            }
+    void advance_to_next_entity() {
+        advance_to_next_row();
+        skip_unmatched_rows();
+    }
 
-            entity_id id = current_archetype.entities[_current_entity_index];
-            if (_core->entity_alive(id)) return;
+    // Sparse terms are only known per row, so rows whose entity fails them are stepped over
+    void skip_unmatched_rows() {
+        if constexpr (_::query_has_sparse_terms_v<T...>) {
+            while (_current_entity_index != INVALID_ARRAY_INDEX &&
+                   !current_row_matches(std::index_sequence_for<T...>()))
+                advance_to_next_row();
         }
     }
 
+    template <size_t... I>
+    bool current_row_matches(std::index_sequence<I...>) {
+        entity_id entity = _current_archetype_entities[_current_entity_index];
+        return (... && _::query_term_row_matches<T>(_chunk_components[I], entity));
+    }
+
     template <size_t... I>
     value_type current_result(std::index_sequence<I...>) {
-        const auto& current_archetype = _core->archetypes[_current_archetype_index];
-        return std::tuple<const entity, T&...>(
-            entity(current_archetype.entities[_current_entity_index], _core),
-            *(T*) current_archetype.component_pools[_component_indices[I]][_current_entity_index]...);
+        entity_id entity = _current_archetype_entities[_current_entity_index];
+        return std::tuple_cat(std::tuple<const saturn::entity>(saturn::entity(entity, _core)),
+                              _::query_term_result<T>(_chunk_components[I], _current_chunk_row, entity)...);
     }
 
   public:
-    static query_iterator begin(_::ecs_core* core, archetype_mask mask) {
-        auto it = query_iterator(core, mask, -1, -1);
+    static query_iterator begin(_::ecs_core* core, array_index cache_index,
+                                const std::array<array_index, sizeof...(T)>& component_ranks,
+                                const std::array<component_id, sizeof...(T)>& component_ids, world_tick last_run_tick,
+                                world_tick run_tick) {
+        auto it = query_iterator(core, cache_index, component_ranks, component_ids, last_run_tick, run_tick, -1, -1);
         it.advance_to_next_archetype(std::index_sequence_for<T...>());
-        it.advance_to_next_alive_entity();
+        it.skip_unmatched_rows();
         return it;
     }
 
-    static query_iterator end(_::ecs_core* core, archetype_mask mask) {
-        return query_iterator(core, mask, core->archetypes.size(), -1);
+    static query_iterator end(_::ecs_core* core, array_index cache_index,
+                              const std::array<array_index, sizeof...(T)>& component_ranks,
+                              const std::array<component_id, sizeof...(T)>& component_ids) {
+        return query_iterator(core, cache_index, component_ranks, component_ids, 0, 0,
+                              core->query_caches[cache_index].archetypes.size(), -1);
     }
 
     query_iterator& operator++() {
-        advance_to_next_alive_entity();
+        advance_to_next_entity();
         return *this;
     }
 
@@ -99,8 +410,8 @@ class query_iterator {
     }
 
     bool operator==(const query_iterator& other) const {
-        return _core == other._core && _mask == other._mask &&
-               _current_archetype_index == other._current_archetype_index &&
+        return _core == other._core && _cache_index == other._cache_index &&
+               _current_cache_archetype_index == other._current_cache_archetype_index &&
                _current_entity_index == other._current_entity_index;
     }
 
@@ -113,32 +424,257 @@ class query_iterator {
     }
 };
 
+// A contiguous run of rows matched by a query, every component is a column so loops over them can be vectorized
+template <typename... T>
+class query_chunk {
+    template <typename... Q>
+    friend class query;
+
+    const entity_id* _entities;
+    size_t _size;
+    std::array<void*, sizeof...(T)> _columns;
+
+    query_chunk(const entity_id* entities, size_t size, const std::array<void*, sizeof...(T)>& columns)
+        : _entities(entities), _size(size), _columns(columns) { }
+
+    template <typename C>
+    static constexpr size_t component_index() {
+        constexpr std::array<bool, sizeof...(T)> matches = {
+            (_::query_term<T>::fetched &&
+             std::is_same_v<std::remove_const_t<C>, std::remove_const_t<typename _::query_term<T>::component_t>>)...};
+        for (size_t i = 0; i < matches.size(); i++) {
+            if (matches[i]) return i;
+        }
+        return sizeof...(T);
+    }
+
+  public:
+    [[nodiscard]] size_t size() const {
+        return _size;
+    }
+
+    [[nodiscard]] std::span<const entity_id> entities() const {
+        return {_entities, _size};
+    }
+
+    // The column of the I-th component of the query, const if the query only reads it. Optional components the
+    // chunk doesn't have give an empty span.
+    template <size_t I>
+    [[nodiscard]] auto components() const {
+        using term = _::query_term<std::tuple_element_t<I, std::tuple<T...>>>;
+        using component_t = typename term::component_t;
+        static_assert(term::fetched, "Filters have no storage");
+        static_assert(!_::is_tag_component_v<component_t>, "Tag components have no storage");
+        return std::span<component_t>((component_t*) _columns[I], _columns[I] ? _size : 0);
+    }
+
+    template <typename C>
+    [[nodiscard]] auto components() const {
+        static_assert(component_index<C>() < sizeof...(T), "Component is not part of the query");
+        return components<component_index<C>()>();
+    }
+};
+
 template <typename... T>
 class query {
     friend class world;
 
     _::ecs_core* _core;
-    archetype_mask _mask;
+    _::query_filter _filter;
+    array_index _cache_index;
+    std::array<component_id, sizeof...(T)> _component_ids;
+    // Rank of each required component in the filter's include mask, INVALID_ARRAY_INDEX for the other terms
+    std::array<array_index, sizeof...(T)> _component_ranks;
+    world_tick _last_run_tick = 0;
+
+    explicit query(_::ecs_core* core)
+        : _core(core),
+          _filter(create_filter(core)),
+          _cache_index(_core->get_or_create_query_cache(_filter)),
+          _component_ids({_::query_term_component_id<T>(core)...}),
+          _component_ranks({create_component_rank<T>()...}) { }
+
+    static _::query_filter create_filter([[maybe_unused]] _::ecs_core* core) {
+        _::query_filter filter = {};
+        (..., add_filter_term<T>(core, filter));
+        return filter;
+    }
+
+    template <typename C>
+    static void add_filter_term(_::ecs_core* core, _::query_filter& filter) {
+        if constexpr (_::query_term_sparse_v<C>) return;
+        component_id id = _::query_term_component_id<C>(core);
+        if constexpr (_::query_term<C>::required) filter.include = _::archetype_mask_add_component(filter.include, id);
+        if constexpr (_::query_term<C>::excluded) filter.exclude = _::archetype_mask_add_component(filter.exclude, id);
+    }
+
+    template <typename C>
+    array_index create_component_rank() {
+        if constexpr (!_::query_term<C>::required || _::query_term_sparse_v<C>) return INVALID_ARRAY_INDEX;
+        component_id id = _core->lookup_component_id<typename _::query_term<C>::component_t>();
+        return _::archetype_mask_component_rank(_filter.include, id);
+    }
 
-    explicit query(_::ecs_core* core) : _core(core), _mask(_core->create_archetype_mask<T...>()) { }
+    // Returns the tick of the previous run and stamps this one. The world tick is advanced past the run tick so writes
+    // made after the run starts, outside of this query, are seen by its next run.
+    std::pair<world_tick, world_tick> start_run() {
+        world_tick last_run_tick = _last_run_tick;
+        _last_run_tick = _core->tick.fetch_add(2) + 1;
+        return {last_run_tick, _last_run_tick};
+    }
 
   public:
     typedef query_iterator<T...> iterator;
 
     iterator begin() {
-        return iterator::begin(_core, _mask);
+        auto [last_run_tick, run_tick] = start_run();
+        return iterator::begin(_core, _cache_index, _component_ranks, _component_ids, last_run_tick, run_tick);
     }
 
     iterator end() {
-        return iterator::end(_core, _mask);
+        return iterator::end(_core, _cache_index, _component_ranks, _component_ids);
     }
 
+    // Number of matches, changed<T> and added<T> are checked against the last run without starting a new one
     size_t count() {
         size_t count = 0;
-        for (const auto& result : *this)
-            count++;
+        if constexpr (_::query_has_sparse_terms_v<T...>) {
+            for (auto [cache_archetype_index, chunk] : matching_chunks(_last_run_tick))
+                count += count_chunk_matches(cache_archetype_index, chunk, std::index_sequence_for<T...>());
+        } else if constexpr (_::query_has_chunk_filters_v<T...>) {
+            const auto& cache = _core->query_caches[_cache_index];
+            for (auto [cache_archetype_index, chunk] : matching_chunks(_last_run_tick)) {
+                const auto& archetype = _core->archetypes[cache.archetypes[cache_archetype_index].archetype_index];
+                count += archetype.storage.chunk_row_count(chunk);
+            }
+        } else {
+            for (const auto& cache_archetype : _core->query_caches[_cache_index].archetypes)
+                count += _core->archetype_entity_count(cache_archetype.archetype_index);
+        }
+        return count;
+    }
+
+    // Calls func(chunk) with a query_chunk for every non-empty chunk the query matches
+    template <typename F>
+    void each_chunk(F&& func) {
+        static_assert(!_::query_has_sparse_terms_v<T...>, "Sparse components aren't stored in chunks");
+        auto [last_run_tick, run_tick] = start_run();
+        for (auto [cache_archetype_index, chunk] : matching_chunks(last_run_tick))
+            func(create_chunk(cache_archetype_index, chunk, run_tick, std::index_sequence_for<T...>()));
+    }
+
+    // Like each_chunk, but the chunks are spread across the world's workers
+    template <typename F>
+    void par_each_chunk(F&& func) {
+        static_assert(!_::query_has_sparse_terms_v<T...>, "Sparse components aren't stored in chunks");
+        auto [last_run_tick, run_tick] = start_run();
+        auto chunks = matching_chunks(last_run_tick);
+        _core->workers->run(chunks.size(), [&](size_t task, size_t) {
+            func(create_chunk(chunks[task].first, chunks[task].second, run_tick, std::index_sequence_for<T...>()));
+        });
+    }
+
+    // Calls func(entity, components...) for every match, spread across the world's workers one chunk at a time. The
+    // world must not change structurally until it returns, record those changes with a command buffer instead.
+    template <typename F>
+    void par_each(F&& func) {
+        auto [last_run_tick, run_tick] = start_run();
+        auto chunks = matching_chunks(last_run_tick);
+        _core->workers->run(chunks.size(), [&](size_t task, size_t) {
+            each_in_chunk(chunks[task].first, chunks[task].second, run_tick, func, std::index_sequence_for<T...>());
+        });
+    }
+
+    // Like par_each, but every worker folds its matches into its own copy of init with func(accumulator, entity,
+    // components...), then the copies are folded together with combine(result, accumulator)
+    template <typename A, typename F, typename C>
+    A par_reduce(A init, F&& func, C&& combine) {
+        struct alignas(SATURN_ECS_COLUMN_ALIGNMENT) worker_accumulator {
+            A value;
+        };
+        std::vector<worker_accumulator> accumulators(_core->workers->size(), worker_accumulator {init});
+
+        auto [last_run_tick, run_tick] = start_run();
+        auto chunks = matching_chunks(last_run_tick);
+        _core->workers->run(chunks.size(), [&](size_t task, size_t worker) {
+            A& accumulator = accumulators[worker].value;
+            each_in_chunk(
+                chunks[task].first, chunks[task].second, run_tick,
+                [&](const entity& entity, auto&&... components) {
+                    func(accumulator, entity, std::forward<decltype(components)>(components)...);
+                },
+                std::index_sequence_for<T...>());
+        });
+
+        for (auto& accumulator : accumulators)
+            combine(init, accumulator.value);
+        return init;
+    }
+
+  private:
+    // (cache archetype index, chunk index) of every non-empty chunk the query matches, including its changed<T> and
+    // added<T> filters
+    std::vector<std::pair<array_index, array_index>> matching_chunks(world_tick last_run_tick) {
+        return matching_chunks(last_run_tick, std::index_sequence_for<T...>());
+    }
+
+    template <size_t... I>
+    std::vector<std::pair<array_index, array_index>> matching_chunks(world_tick last_run_tick,
+                                                                     std::index_sequence<I...>) {
+        std::vector<std::pair<array_index, array_index>> chunks;
+        const auto& cache = _core->query_caches[_cache_index];
+        for (array_index i = 0; i < cache.archetypes.size(); i++) {
+            const auto& archetype = _core->archetypes[cache.archetypes[i].archetype_index];
+            [[maybe_unused]] std::array<array_index, sizeof...(T)> column_indices = {_::query_term_column_index<T>(
+                archetype, cache.archetypes[i], _component_ranks[I], _component_ids[I])...};
+            for (array_index chunk = 0; chunk < archetype.storage.chunk_count(); chunk++) {
+                if (!archetype.storage.chunk_row_count(chunk)) continue;
+                if ((... && _::query_term_chunk_matches<T>(archetype, column_indices[I], chunk, last_run_tick)))
+                    chunks.emplace_back(i, chunk);
+            }
+        }
+        return chunks;
+    }
+
+    // Stamps the chunk's mutable columns with the run tick, chunks can run on different workers but never share a
+    // stamp
+    template <size_t... I>
+    query_chunk<T...> create_chunk(array_index cache_archetype_index, array_index chunk, world_tick run_tick,
+                                   std::index_sequence<I...>) {
+        const auto& cache_archetype = _core->query_caches[_cache_index].archetypes[cache_archetype_index];
+        auto& archetype = _core->archetypes[cache_archetype.archetype_index];
+        std::array<array_index, sizeof...(T)> column_indices = {
+            _::query_term_column_index<T>(archetype, cache_archetype, _component_ranks[I], _component_ids[I])...};
+        (..., _::query_term_mark_chunk<T>(archetype, column_indices[I], chunk, run_tick));
+        return query_chunk<T...>(
+            archetype.entities.data() + chunk * archetype.storage.chunk_capacity(),
+            archetype.storage.chunk_row_count(chunk),
+            {_::query_term_chunk<T>(_core, archetype, column_indices[I], _component_ids[I], chunk)...});
+    }
+
+    template <size_t... I>
+    size_t count_chunk_matches(array_index cache_archetype_index, array_index chunk, std::index_sequence<I...>) {
+        const auto& archetype =
+            _core->archetypes[_core->query_caches[_cache_index].archetypes[cache_archetype_index].archetype_index];
+        const entity_id* entities = archetype.entities.data() + chunk * archetype.storage.chunk_capacity();
+        std::array<void*, sizeof...(T)> sparse_sets = {
+            _::query_term_chunk<T>(_core, archetype, INVALID_ARRAY_INDEX, _component_ids[I], chunk)...};
+        size_t count = 0;
+        for (array_index row = 0; row < archetype.storage.chunk_row_count(chunk); row++)
+            count += (... && _::query_term_row_matches<T>(sparse_sets[I], entities[row]));
         return count;
     }
+
+    template <typename F, size_t... I>
+    void each_in_chunk(array_index cache_archetype_index, array_index chunk, world_tick run_tick, F&& func,
+                       std::index_sequence<I...>) {
+        query_chunk<T...> rows = create_chunk(cache_archetype_index, chunk, run_tick, std::index_sequence_for<T...>());
+        for (array_index row = 0; row < rows._size; row++) {
+            if (!(... && _::query_term_row_matches<T>(rows._columns[I], rows._entities[row]))) continue;
+            std::apply(func, std::tuple_cat(std::tuple<const entity>(entity(rows._entities[row], _core)),
+                                            _::query_term_result<T>(rows._columns[I], row, rows._entities[row])...));
+        }
+    }
 };
 
 } // namespace saturn
@@ -9,9 +9,9 @@ typedef stage_id stage;
 
 namespace stages {
 
-static stage pre_update = _::ecs_core::create_stage_id();
-static stage update = _::ecs_core::create_stage_id();
-static stage post_update = _::ecs_core::create_stage_id();
+inline const stage pre_update = _::ecs_core::create_stage_id();
+inline const stage update = _::ecs_core::create_stage_id();
+inline const stage post_update = _::ecs_core::create_stage_id();
 
 } // namespace stages
 
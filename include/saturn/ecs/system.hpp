@@ -1,24 +1,62 @@
 #ifndef SATURN_SYSTEM_HPP
 #define SATURN_SYSTEM_HPP
 
+#include "command_buffer.hpp"
 #include "ecs_core.hpp"
 #include "query.hpp"
 #include "trait_helpers.h"
 
 namespace saturn {
 
+namespace _ {
+struct system_access;
+}
+
 class system_context {
     friend class world;
 
     _::ecs_core* _core;
     delta_time _dt;
-
-    system_context(_::ecs_core* core, delta_time dt) : _core(core), _dt(dt) { }
+    // One buffer per worker, so par_each callbacks can record commands without sharing a buffer
+    std::vector<std::unique_ptr<command_buffer>>* _commands;
+    const _::system_access* _access;
+
+    system_context(_::ecs_core* core, delta_time dt, std::vector<std::unique_ptr<command_buffer>>* commands,
+                   const _::system_access* access)
+        : _core(core), _dt(dt), _commands(commands), _access(access) { }
+
+    bool declares_resource(_::type_index resource, bool write) const;
+
+    template <typename T>
+    T& find_declared_resource(bool write) const {
+        if (!declares_resource(_::lookup_resource_index<std::remove_const_t<T>>(), write))
+            throw std::runtime_error("Resource is not declared by the system");
+        T* resource = _core->find_resource<T>();
+        if (!resource) throw std::runtime_error("Resource does not exist");
+        return *resource;
+    }
 
   public:
     [[nodiscard]] delta_time dt() const {
         return _dt;
     }
+
+    // Structural changes recorded here are applied once every system in the stage has run
+    [[nodiscard]] command_buffer& commands() {
+        return *(*_commands)[_core->workers->worker_index()];
+    }
+
+    // The world's T, the system must declare it with resource<const T> or resource<T>
+    template <typename T>
+    [[nodiscard]] const T& resource() const {
+        return find_declared_resource<const T>(false);
+    }
+
+    // The world's T, the system must declare it with resource<T>
+    template <typename T>
+    [[nodiscard]] T& resource_mut() const {
+        return find_declared_resource<T>(true);
+    }
 };
 
 template <typename... T>
@@ -42,8 +80,87 @@ struct system {
 
 namespace _ {
 
+// The components a system's query reads and writes, const components are only read. Systems whose accesses don't
+// conflict may run at the same time, a system that fetches no components or declares exclusive may touch anything so
+// it always runs alone.
+struct system_access {
+    archetype_mask reads;
+    archetype_mask writes;
+    // Resource indices of the resources the system declared
+    std::vector<type_index> resource_reads = {};
+    std::vector<type_index> resource_writes = {};
+    bool exclusive;
+};
+
+template <typename T>
+void add_system_access(ecs_core* core, system_access& access) {
+    using component_t = typename query_term<T>::component_t;
+    if constexpr (query_term<T>::exclusive) {
+        access.exclusive = true;
+        return;
+    }
+    if constexpr (query_term<T>::resource) {
+        type_index index = lookup_resource_index<std::remove_const_t<component_t>>();
+        if (std::is_const_v<component_t>) access.resource_reads.push_back(index);
+        else access.resource_writes.push_back(index);
+        return;
+    }
+    // Filters only look at archetype masks, which can't change while systems run, but changed<T> and added<T> also
+    // read T's change ticks
+    constexpr bool reads_ticks = query_term<T>::changed_filter || query_term<T>::added_filter;
+    if constexpr (!query_term<T>::fetched && !reads_ticks) return;
+    component_id id = core->lookup_component_id<component_t>();
+    // Tags are handed out by value, so they can't be written through a query
+    if (std::is_const_v<component_t> || is_tag_component_v<component_t>)
+        access.reads = archetype_mask_add_component(access.reads, id);
+    else access.writes = archetype_mask_add_component(access.writes, id);
+}
+
+template <typename... T>
+struct system_access_of {
+    static system_access create([[maybe_unused]] ecs_core* core) {
+        // A system that declares resources but fetches no components only touches its resources
+        system_access access {.reads = {},
+                              .writes = {},
+                              .resource_reads = {},
+                              .resource_writes = {},
+                              .exclusive = !(... || (query_term<T>::fetched || query_term<T>::resource))};
+        (..., add_system_access<T>(core, access));
+        return access;
+    }
+};
+
+inline bool resource_accesses_intersect(const std::vector<type_index>& resources,
+                                        const std::vector<type_index>& other) {
+    return std::any_of(resources.begin(), resources.end(), [&](type_index resource) {
+        return std::find(other.begin(), other.end(), resource) != other.end();
+    });
+}
+
+inline bool system_accesses_conflict(const system_access& access, const system_access& other) {
+    return access.exclusive || other.exclusive || archetype_mask_intersects(access.writes, other.writes) ||
+           archetype_mask_intersects(access.writes, other.reads) ||
+           archetype_mask_intersects(access.reads, other.writes) ||
+           resource_accesses_intersect(access.resource_writes, other.resource_writes) ||
+           resource_accesses_intersect(access.resource_writes, other.resource_reads) ||
+           resource_accesses_intersect(access.resource_reads, other.resource_writes);
+}
+
+} // namespace _
+
+inline bool system_context::declares_resource(_::type_index resource, bool write) const {
+    auto declares = [&](const std::vector<_::type_index>& resources) {
+        return std::find(resources.begin(), resources.end(), resource) != resources.end();
+    };
+    return declares(_access->resource_writes) || (!write && declares(_access->resource_reads));
+}
+
+namespace _ {
+
 class system_base {
   public:
+    system_access access = {};
+
     virtual ~system_base() = default;
     virtual void run(system_context& ctx) = 0;
 };
@@ -7,15 +7,35 @@
 namespace saturn {
 
 class universe {
-    universe() = default;
+    std::shared_ptr<component_registry> _registry;
+    std::shared_ptr<thread_pool> _workers;
+
+    universe() : _registry(component_registry::create()), _workers(thread_pool::create()) { }
 
   public:
     universe(const universe&) = delete;
     static std::unique_ptr<universe> create() {
         return std::unique_ptr<universe>(new universe());
     }
+
+    // The registry shared by every world created without one of its own
+    [[nodiscard]] component_registry& registry() {
+        return *_registry;
+    }
+
     std::unique_ptr<world> create_world() {
-        return std::unique_ptr<world>(new world());
+        return create_world(_registry);
+    }
+
+    // Creates a world that allocates its storage from memory, such as a huge_page_allocator or a tracking_allocator
+    std::unique_ptr<world> create_world(std::shared_ptr<allocator> memory) {
+        return create_world(_registry, std::move(memory));
+    }
+
+    // Creates a world with its own component ids, pass component_registry::create() to isolate it from other worlds
+    std::unique_ptr<world> create_world(std::shared_ptr<component_registry> registry,
+                                        std::shared_ptr<allocator> memory = heap_allocator::create()) {
+        return std::unique_ptr<world>(new world(std::move(registry), _workers, std::move(memory)));
     }
 };
 
@@ -0,0 +1,138 @@
+#ifndef SATURN_ALLOCATOR_HPP
+#define SATURN_ALLOCATOR_HPP
+
+#include "../ecs_types.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace saturn {
+
+// Provides the memory a world keeps its components, entity tables and archetypes in. Alignments are powers of two, and
+// memory is always deallocated with the size and alignment it was allocated with. Systems record commands concurrently,
+// so allocators must be thread-safe.
+class allocator {
+  public:
+    virtual ~allocator() = default;
+
+    // Throws std::bad_alloc when out of memory
+    virtual void* allocate(size_t size, size_t alignment) = 0;
+    virtual void deallocate(void* data, size_t size, size_t alignment) = 0;
+};
+
+// Allocates straight from the process heap
+class heap_allocator : public allocator {
+    heap_allocator() = default;
+
+  public:
+    static std::shared_ptr<heap_allocator> create() {
+        return std::shared_ptr<heap_allocator>(new heap_allocator());
+    }
+
+    void* allocate(size_t size, size_t alignment) override;
+    void deallocate(void* data, size_t size, size_t alignment) override;
+};
+
+// Carves allocations out of large regions mapped with mmap and backed by transparent huge pages where the OS supports
+// them, which cuts TLB misses when iterating worlds that span gigabytes. Freed memory is kept for later allocations of
+// the same size and alignment, regions are only unmapped when the allocator is destroyed. Allocations larger than a
+// quarter of a region get a mapping of their own, which is unmapped when they're freed.
+class huge_page_allocator : public allocator {
+    size_t _region_size;
+    std::mutex _mutex;
+    std::vector<std::pair<void*, size_t>> _regions = {};
+    size_t _region_offset = 0;
+    // Freed blocks, keyed by size and alignment
+    std::map<std::pair<size_t, size_t>, std::vector<void*>> _free_blocks = {};
+
+    explicit huge_page_allocator(size_t region_size);
+
+  public:
+    ~huge_page_allocator() override;
+    huge_page_allocator(const huge_page_allocator&) = delete;
+
+    // The region size is rounded up to a multiple of SATURN_ECS_HUGE_PAGE_SIZE
+    static std::shared_ptr<huge_page_allocator> create(size_t region_size = SATURN_ECS_HUGE_PAGE_REGION_SIZE) {
+        return std::shared_ptr<huge_page_allocator>(new huge_page_allocator(region_size));
+    }
+
+    void* allocate(size_t size, size_t alignment) override;
+    void deallocate(void* data, size_t size, size_t alignment) override;
+
+  private:
+    [[nodiscard]] bool owns_mapping(size_t size) const;
+};
+
+// Forwards to another allocator and counts the bytes that are currently allocated through it. Give every world its own
+// to see how much memory each one uses.
+class tracking_allocator : public allocator {
+    std::shared_ptr<allocator> _upstream;
+    std::atomic<size_t> _allocated_bytes = 0;
+    std::atomic<size_t> _peak_allocated_bytes = 0;
+    std::atomic<size_t> _allocation_count = 0;
+
+    explicit tracking_allocator(std::shared_ptr<allocator> upstream) : _upstream(std::move(upstream)) { }
+
+  public:
+    static std::shared_ptr<tracking_allocator> create(std::shared_ptr<allocator> upstream = heap_allocator::create()) {
+        return std::shared_ptr<tracking_allocator>(new tracking_allocator(std::move(upstream)));
+    }
+
+    [[nodiscard]] size_t allocated_bytes() const {
+        return _allocated_bytes;
+    }
+
+    [[nodiscard]] size_t peak_allocated_bytes() const {
+        return _peak_allocated_bytes;
+    }
+
+    // The number of allocations that haven't been freed yet
+    [[nodiscard]] size_t allocation_count() const {
+        return _allocation_count;
+    }
+
+    void* allocate(size_t size, size_t alignment) override;
+    void deallocate(void* data, size_t size, size_t alignment) override;
+};
+
+namespace _ {
+
+// Lets standard containers allocate from a world's allocator
+template <typename T>
+struct table_allocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    allocator* memory;
+
+    explicit table_allocator(allocator* memory) : memory(memory) { }
+
+    template <typename U>
+    table_allocator(const table_allocator<U>& other) : memory(other.memory) { }
+
+    T* allocate(size_t count) {
+        return (T*) memory->allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T* data, size_t count) {
+        memory->deallocate(data, count * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const table_allocator<U>& other) const {
+        return memory == other.memory;
+    }
+};
+
+template <typename T>
+using table = std::vector<T, table_allocator<T>>;
+
+} // namespace _
+
+} // namespace saturn
+
+#endif
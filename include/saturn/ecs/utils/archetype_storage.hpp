@@ -0,0 +1,269 @@
+#ifndef SATURN_ARCHETYPE_STORAGE_HPP
+#define SATURN_ARCHETYPE_STORAGE_HPP
+
+#include "../ecs_types.h"
+#include "allocator.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace saturn::_ {
+
+// Move constructs the component at destination from source and destroys source
+typedef void (*component_relocate_func)(void* destination, void* source);
+typedef void (*component_destroy_func)(void* component);
+
+struct archetype_column {
+    component_id component;
+    size_t component_size;
+    size_t component_alignment;
+    // Null for trivially copyable components, which are relocated with memcpy
+    component_relocate_func relocate;
+    // Null for trivially destructible components
+    component_destroy_func destroy;
+    // Byte offset of the column from the start of each chunk
+    size_t offset;
+};
+
+// Stores the components of an archetype in fixed-size chunks. Each chunk holds every column for a power of two number
+// of rows, so growing never copies existing components and a row is found with a shift and a mask. Every column starts
+// on a SATURN_ECS_COLUMN_ALIGNMENT boundary (or the component's alignment if it is larger) so it can be used with
+// aligned vector loads. Chunks come from the world's allocator.
+class archetype_storage {
+    // Null for storages that never allocate
+    allocator* _memory = nullptr;
+    std::vector<archetype_column> _columns = {};
+    std::vector<void*> _chunks = {};
+    size_t _chunk_size = 0;
+    size_t _chunk_alignment = SATURN_ECS_COLUMN_ALIGNMENT;
+    bool _trivially_destructible = true;
+    array_index _chunk_capacity_shift = 0;
+    array_index _chunk_capacity_mask = 0;
+    size_t _size = 0;
+    // Last tick each column of each chunk was written to and had a component added to, indexed by chunk * columns
+    std::vector<world_tick> _changed_ticks = {};
+    std::vector<world_tick> _added_ticks = {};
+
+  public:
+    archetype_storage() = default;
+
+    archetype_storage(std::vector<archetype_column> columns, allocator* memory)
+        : _memory(memory), _columns(std::move(columns)) {
+        size_t row_size = 0;
+        for (auto& column : _columns) {
+            _chunk_alignment = std::max(_chunk_alignment, column.component_alignment);
+            _trivially_destructible &= !column.destroy;
+            row_size += column.component_size;
+        }
+
+        // Archetypes without columns never allocate, so they can have as many rows per chunk as they want
+        _chunk_capacity_shift = 31;
+        if (row_size) {
+            _chunk_capacity_shift = 0;
+            while (((size_t) 2 << _chunk_capacity_shift) * row_size <= SATURN_ECS_CHUNK_SIZE)
+                _chunk_capacity_shift++;
+            // Padding each column to its alignment can push the chunk over its size, so give up rows until it fits
+            while (_chunk_capacity_shift && layout_columns() > SATURN_ECS_CHUNK_SIZE)
+                _chunk_capacity_shift--;
+        }
+        _chunk_capacity_mask = ((array_index) 1 << _chunk_capacity_shift) - 1;
+        _chunk_size = align(std::max((size_t) SATURN_ECS_CHUNK_SIZE, layout_columns()), _chunk_alignment);
+    }
+
+    ~archetype_storage() {
+        if (!_trivially_destructible) {
+            for (array_index row = 0; row < _size; row++)
+                destroy_row(row);
+        }
+        for (void* chunk : _chunks)
+            _memory->deallocate(chunk, _chunk_size, _chunk_alignment);
+    }
+
+    archetype_storage(const archetype_storage&) = delete;
+    archetype_storage& operator=(const archetype_storage&) = delete;
+
+    archetype_storage(archetype_storage&& other) noexcept
+        : _memory(other._memory),
+          _columns(std::move(other._columns)),
+          _chunks(std::move(other._chunks)),
+          _chunk_size(other._chunk_size),
+          _chunk_alignment(other._chunk_alignment),
+          _trivially_destructible(other._trivially_destructible),
+          _chunk_capacity_shift(other._chunk_capacity_shift),
+          _chunk_capacity_mask(other._chunk_capacity_mask),
+          _size(other._size),
+          _changed_ticks(std::move(other._changed_ticks)),
+          _added_ticks(std::move(other._added_ticks)) {
+        other._chunks.clear();
+        other._size = 0;
+    }
+
+    archetype_storage& operator=(archetype_storage&& other) noexcept {
+        std::swap(_memory, other._memory);
+        std::swap(_columns, other._columns);
+        std::swap(_chunks, other._chunks);
+        std::swap(_chunk_size, other._chunk_size);
+        std::swap(_chunk_alignment, other._chunk_alignment);
+        std::swap(_trivially_destructible, other._trivially_destructible);
+        std::swap(_chunk_capacity_shift, other._chunk_capacity_shift);
+        std::swap(_chunk_capacity_mask, other._chunk_capacity_mask);
+        std::swap(_size, other._size);
+        std::swap(_changed_ticks, other._changed_ticks);
+        std::swap(_added_ticks, other._added_ticks);
+        return *this;
+    }
+
+    [[nodiscard]] const std::vector<archetype_column>& columns() const {
+        return _columns;
+    }
+
+    [[nodiscard]] const archetype_column& column(array_index column) const {
+        return _columns[column];
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _size;
+    }
+
+    [[nodiscard]] size_t chunk_capacity() const {
+        return (size_t) 1 << _chunk_capacity_shift;
+    }
+
+    // The number of rows the allocated chunks can hold without allocating
+    [[nodiscard]] size_t capacity() const {
+        return _chunks.size() << _chunk_capacity_shift;
+    }
+
+    // The number of chunks that contain at least one row
+    [[nodiscard]] size_t chunk_count() const {
+        return (_size + _chunk_capacity_mask) >> _chunk_capacity_shift;
+    }
+
+    [[nodiscard]] size_t chunk_row_count(array_index chunk) const {
+        return std::min(chunk_capacity(), _size - ((size_t) chunk << _chunk_capacity_shift));
+    }
+
+    [[nodiscard]] void* chunk_column(array_index chunk, array_index column) const {
+        return (uint8_t*) _chunks[chunk] + _columns[column].offset;
+    }
+
+    [[nodiscard]] void* component(array_index column, array_index row) const {
+        const archetype_column& archetype_column = _columns[column];
+        return (uint8_t*) _chunks[row >> _chunk_capacity_shift] + archetype_column.offset +
+               (row & _chunk_capacity_mask) * archetype_column.component_size;
+    }
+
+    [[nodiscard]] world_tick chunk_changed_tick(array_index chunk, array_index column) const {
+        return _changed_ticks[chunk * _columns.size() + column];
+    }
+
+    [[nodiscard]] world_tick chunk_added_tick(array_index chunk, array_index column) const {
+        return _added_ticks[chunk * _columns.size() + column];
+    }
+
+    void mark_chunk_changed(array_index chunk, array_index column, world_tick tick) {
+        world_tick& changed_tick = _changed_ticks[chunk * _columns.size() + column];
+        changed_tick = std::max(changed_tick, tick);
+    }
+
+    void mark_changed(array_index column, array_index row, world_tick tick) {
+        mark_chunk_changed(row >> _chunk_capacity_shift, column, tick);
+    }
+
+    void mark_added(array_index column, array_index row, world_tick tick) {
+        mark_changed(column, row, tick);
+        world_tick& added_tick = _added_ticks[(row >> _chunk_capacity_shift) * _columns.size() + column];
+        added_tick = std::max(added_tick, tick);
+    }
+
+    // Carries the ticks of a component relocated here from another chunk, so moving it never hides a change
+    void merge_ticks(array_index column, array_index row, const archetype_storage& source, array_index source_column,
+                     array_index source_row) {
+        array_index source_chunk = source_row >> source._chunk_capacity_shift;
+        mark_changed(column, row, source.chunk_changed_tick(source_chunk, source_column));
+        world_tick& added_tick = _added_ticks[(row >> _chunk_capacity_shift) * _columns.size() + column];
+        added_tick = std::max(added_tick, source.chunk_added_tick(source_chunk, source_column));
+    }
+
+    // Allocates chunks until the storage can hold rows without allocating
+    void reserve(size_t rows) {
+        if (_columns.empty()) return;
+        while (_chunks.size() << _chunk_capacity_shift < rows)
+            allocate_chunk();
+    }
+
+    // Frees the chunks past the last row, keeping up to spare_chunks of them for rows added later
+    void shrink_to_fit(size_t spare_chunks = 0) {
+        size_t chunk_count = std::min(_chunks.size(), this->chunk_count() + spare_chunks);
+        for (size_t i = chunk_count; i < _chunks.size(); i++)
+            _memory->deallocate(_chunks[i], _chunk_size, _chunk_alignment);
+        _chunks.resize(chunk_count);
+        _chunks.shrink_to_fit();
+        _changed_ticks.resize(chunk_count * _columns.size());
+        _changed_ticks.shrink_to_fit();
+        _added_ticks.resize(chunk_count * _columns.size());
+        _added_ticks.shrink_to_fit();
+    }
+
+    array_index push_back() {
+        if (!_columns.empty() && _size == _chunks.size() << _chunk_capacity_shift) allocate_chunk();
+        return _size++;
+    }
+
+    void relocate_component(array_index column, void* destination, void* source) const {
+        const archetype_column& archetype_column = _columns[column];
+        if (archetype_column.relocate) archetype_column.relocate(destination, source);
+        else std::memcpy(destination, source, archetype_column.component_size);
+    }
+
+    void destroy_component(array_index column, array_index row) const {
+        const archetype_column& archetype_column = _columns[column];
+        if (archetype_column.destroy) archetype_column.destroy(component(column, row));
+    }
+
+    void destroy_row(array_index row) const {
+        if (_trivially_destructible) return;
+        for (array_index i = 0; i < _columns.size(); i++)
+            destroy_component(i, row);
+    }
+
+    // Relocates the last row into the given row and shrinks the storage by one. The components in the given row must
+    // already have been destroyed or relocated.
+    void swap_remove(array_index row) {
+        array_index last_row = _size - 1;
+        if (row != last_row) {
+            for (array_index i = 0; i < _columns.size(); i++) {
+                relocate_component(i, component(i, row), component(i, last_row));
+                if ((row ^ last_row) >> _chunk_capacity_shift) merge_ticks(i, row, *this, i, last_row);
+            }
+        }
+        _size--;
+    }
+
+  private:
+    void allocate_chunk() {
+        _chunks.push_back(_memory->allocate(_chunk_size, _chunk_alignment));
+        _changed_ticks.resize(_chunks.size() * _columns.size(), 0);
+        _added_ticks.resize(_chunks.size() * _columns.size(), 0);
+    }
+
+    static size_t align(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Assigns each column its offset for the current chunk capacity and returns the number of bytes used
+    size_t layout_columns() {
+        size_t offset = 0;
+        for (auto& column : _columns) {
+            offset = align(offset, std::max(column.component_alignment, (size_t) SATURN_ECS_COLUMN_ALIGNMENT));
+            column.offset = offset;
+            offset += column.component_size << _chunk_capacity_shift;
+        }
+        return offset;
+    }
+};
+
+} // namespace saturn::_
+
+#endif
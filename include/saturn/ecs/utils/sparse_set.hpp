@@ -0,0 +1,134 @@
+#ifndef SATURN_SPARSE_SET_HPP
+#define SATURN_SPARSE_SET_HPP
+
+#include "archetype_storage.hpp"
+
+namespace saturn::_ {
+
+array_index entity_id_index(entity_id id);
+
+// Stores one component type for the entities that have it, outside of their archetype. Components are kept densely in
+// fixed-size pages next to the entity they belong to, and a sparse array maps entity indices to their dense index.
+// Adding and removing a component is O(1) and never moves the rest of the entity, removing relocates the last
+// component into the freed slot. Growing never moves existing components.
+class sparse_set {
+    allocator* _memory;
+    size_t _component_size;
+    size_t _component_alignment;
+    component_relocate_func _relocate;
+    component_destroy_func _destroy;
+    array_index _page_capacity_shift = 0;
+    array_index _page_capacity_mask = 0;
+    size_t _page_size = 0;
+    // Dense index of every entity index, INVALID_ARRAY_INDEX for entities without the component
+    table<array_index> _sparse;
+    table<entity_id> _dense;
+    std::vector<void*> _pages = {};
+
+  public:
+    sparse_set(size_t component_size, size_t component_alignment, component_relocate_func relocate,
+               component_destroy_func destroy, allocator* memory)
+        : _memory(memory),
+          _component_size(component_size),
+          _component_alignment(std::max(component_alignment, (size_t) SATURN_ECS_COLUMN_ALIGNMENT)),
+          _relocate(relocate),
+          _destroy(destroy),
+          _sparse(table_allocator<array_index>(memory)),
+          _dense(table_allocator<entity_id>(memory)) {
+        // Tag components have no storage, so their pages are never allocated
+        _page_capacity_shift = 31;
+        if (_component_size) {
+            _page_capacity_shift = 0;
+            while (((size_t) 2 << _page_capacity_shift) * _component_size <= SATURN_ECS_CHUNK_SIZE)
+                _page_capacity_shift++;
+        }
+        _page_capacity_mask = ((array_index) 1 << _page_capacity_shift) - 1;
+        _page_size = _component_size << _page_capacity_shift;
+    }
+
+    ~sparse_set() {
+        if (_destroy) {
+            for (array_index i = 0; i < _dense.size(); i++)
+                _destroy(at(i));
+        }
+        for (void* page : _pages)
+            _memory->deallocate(page, _page_size, _component_alignment);
+    }
+
+    sparse_set(const sparse_set&) = delete;
+    sparse_set& operator=(const sparse_set&) = delete;
+
+    [[nodiscard]] size_t size() const {
+        return _dense.size();
+    }
+
+    [[nodiscard]] const table<entity_id>& entities() const {
+        return _dense;
+    }
+
+    // The number of components the allocated pages can hold without allocating
+    [[nodiscard]] size_t capacity() const {
+        return _pages.size() << _page_capacity_shift;
+    }
+
+    [[nodiscard]] bool contains(array_index entity_index) const {
+        return entity_index < _sparse.size() && _sparse[entity_index] != INVALID_ARRAY_INDEX;
+    }
+
+    // Null if the entity doesn't have the component or it is a tag
+    [[nodiscard]] void* find(array_index entity_index) const {
+        return contains(entity_index) ? at(_sparse[entity_index]) : nullptr;
+    }
+
+    [[nodiscard]] void* at(array_index dense_index) const {
+        if (!_component_size) return nullptr;
+        return (uint8_t*) _pages[dense_index >> _page_capacity_shift] +
+               (dense_index & _page_capacity_mask) * _component_size;
+    }
+
+    // Adds the entity, which must not be in the set yet, and returns its uninitialized component
+    void* emplace(entity_id entity) {
+        array_index entity_index = entity_id_index(entity);
+        if (_sparse.size() <= entity_index) _sparse.resize(entity_index + 1, INVALID_ARRAY_INDEX);
+        array_index dense_index = _dense.size();
+        if (_component_size && dense_index == _pages.size() << _page_capacity_shift)
+            _pages.push_back(_memory->allocate(_page_size, _component_alignment));
+        _sparse[entity_index] = dense_index;
+        _dense.push_back(entity);
+        return at(dense_index);
+    }
+
+    // Frees the pages past the last component, keeping up to spare_pages of them, and drops the trailing entity indices
+    // that don't have the component
+    void shrink_to_fit(size_t spare_pages = 0) {
+        size_t used_pages = (_dense.size() + _page_capacity_mask) >> _page_capacity_shift;
+        size_t page_count = std::min(_pages.size(), used_pages + spare_pages);
+        for (size_t i = page_count; i < _pages.size(); i++)
+            _memory->deallocate(_pages[i], _page_size, _component_alignment);
+        _pages.resize(page_count);
+        _pages.shrink_to_fit();
+        _dense.shrink_to_fit();
+        while (!_sparse.empty() && _sparse.back() == INVALID_ARRAY_INDEX)
+            _sparse.pop_back();
+        _sparse.shrink_to_fit();
+    }
+
+    // Destroys the entity's component, which must exist, and moves the last component into its slot
+    void erase(array_index entity_index) {
+        array_index dense_index = _sparse[entity_index];
+        array_index last_index = _dense.size() - 1;
+        if (_destroy) _destroy(at(dense_index));
+        if (dense_index != last_index) {
+            if (_relocate) _relocate(at(dense_index), at(last_index));
+            else if (_component_size) std::memcpy(at(dense_index), at(last_index), _component_size);
+            _dense[dense_index] = _dense[last_index];
+            _sparse[entity_id_index(_dense[dense_index])] = dense_index;
+        }
+        _dense.pop_back();
+        _sparse[entity_index] = INVALID_ARRAY_INDEX;
+    }
+};
+
+} // namespace saturn::_
+
+#endif
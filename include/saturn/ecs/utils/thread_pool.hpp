@@ -0,0 +1,76 @@
+#ifndef SATURN_THREAD_POOL_HPP
+#define SATURN_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace saturn {
+
+// Runs batches of tasks on a fixed set of workers. Each worker starts a batch on its own contiguous share of the tasks
+// and steals from the others once it runs out. The thread calling run is worker 0, the other threads are only started
+// the first time a batch needs them.
+class thread_pool {
+  public:
+    typedef std::function<void(size_t task, size_t worker)> task_func;
+
+  private:
+    struct worker_queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    size_t _worker_count;
+    std::vector<std::thread> _threads = {};
+    std::unique_ptr<worker_queue[]> _queues;
+
+    // Serializes batches started from different threads
+    std::mutex _run_mutex;
+    std::mutex _mutex;
+    std::condition_variable _start;
+    std::condition_variable _finished;
+    const task_func* _func = nullptr;
+    uint64_t _batch = 0;
+    size_t _busy_threads = 0;
+    bool _stopping = false;
+    std::exception_ptr _exception = nullptr;
+
+    explicit thread_pool(size_t worker_count);
+
+  public:
+    ~thread_pool();
+    thread_pool(const thread_pool&) = delete;
+
+    // The worker count includes the thread calling run, zero uses one worker per hardware thread
+    static std::shared_ptr<thread_pool> create(size_t worker_count = 0) {
+        if (!worker_count) worker_count = std::thread::hardware_concurrency();
+        return std::shared_ptr<thread_pool>(new thread_pool(worker_count));
+    }
+
+    [[nodiscard]] size_t size() const {
+        return _worker_count;
+    }
+
+    // Index of the worker running on the calling thread, 0 for threads that don't belong to the pool
+    [[nodiscard]] size_t worker_index() const;
+
+    // Calls func for every task in [0, task_count) and returns once they have all finished, rethrowing the first
+    // exception a task threw. Batches started from inside a task run inline on the worker that started them.
+    void run(size_t task_count, const task_func& func);
+
+  private:
+    void start_threads();
+    void thread_main(size_t worker);
+    void work(size_t worker);
+    bool pop_task(size_t worker, size_t& task);
+};
+
+} // namespace saturn
+
+#endif
@@ -1,12 +1,16 @@
 #ifndef SATURN_WORLD_HPP
 #define SATURN_WORLD_HPP
 
+#include "command_buffer.hpp"
 #include "ecs_core.hpp"
 #include "entity.hpp"
+#include "observer.hpp"
 #include "query.hpp"
 #include "stage.h"
 #include "system.hpp"
 #include "trait_helpers.h"
+#include <algorithm>
+#include <map>
 #include <unordered_set>
 
 namespace saturn {
@@ -19,15 +23,34 @@ class world {
     // Stages
     std::unordered_map<system_id, std::unique_ptr<_::system_base>> _systems = {};
     std::unordered_map<stage_id, std::unordered_set<system_id>> _systems_by_stage = {};
+    std::unordered_map<system_id, std::vector<std::unique_ptr<command_buffer>>> _command_buffers = {};
+    // Systems of each stage grouped into batches that run one after the other, built on the stage's first update
+    std::unordered_map<stage_id, std::vector<std::vector<system_id>>> _stage_schedules = {};
     // TODO: Separate map for custom stages
 
+    // Observers, ordered by creation
+    std::map<observer_id, _::observer> _observers = {};
+    // Events swapped out of the core while they're delivered, kept to reuse their capacity
+    std::array<std::vector<std::vector<entity_id>>, OBSERVER_EVENT_COUNT> _delivered_observer_events = {};
+    std::vector<entity> _observed_entities = {};
+
+    // Archetypes and sparse sets compacted at the end of every update, and where the next update picks up
+    size_t _compaction_budget = 0;
+    size_t _compaction_cursor = 0;
+
     delta_time _update_dt = 0;
     std::chrono::high_resolution_clock::time_point _last_update_time = std::chrono::high_resolution_clock::now();
     std::chrono::high_resolution_clock::time_point _current_update_time = std::chrono::high_resolution_clock::now();
 
     // TODO: Make private
   public:
-    world() : _core(std::make_unique<_::ecs_core>()) {
+    world() : world(component_registry::create()) { }
+
+    explicit world(std::shared_ptr<component_registry> registry) : world(std::move(registry), thread_pool::create()) { }
+
+    world(std::shared_ptr<component_registry> registry, std::shared_ptr<thread_pool> workers,
+          std::shared_ptr<allocator> memory = heap_allocator::create())
+        : _core(std::make_unique<_::ecs_core>(std::move(registry), std::move(workers), std::move(memory))) {
         _systems_by_stage[stages::pre_update] = {};
         _systems_by_stage[stages::update] = {};
         _systems_by_stage[stages::post_update] = {};
@@ -37,29 +60,92 @@ class world {
     ~world() = default;
     world(const world&) = delete;
 
+    [[nodiscard]] component_registry& registry() {
+        return *_core->registry;
+    }
+
+    // The pool that runs parallel queries, shared with the other worlds of a universe
+    [[nodiscard]] thread_pool& workers() {
+        return *_core->workers;
+    }
+
+    // The allocator the world's components, entity tables and archetypes live in
+    [[nodiscard]] allocator& memory() {
+        return *_core->memory;
+    }
+
     [[nodiscard]] entity create_entity() {
-        _::archetype& empty_archetype = _core->archetypes[_core->empty_archetype_index];
-        if (_core->free_entities.empty()) {
-            entity_id id = _::create_entity_id(_core->entities.size(), 0);
-            _core->entities.push_back(id);
-            _core->entity_archetypes.push_back({empty_archetype.id, 0});
-            _core->add_entity_to_archetype(_core->entities.back(), empty_archetype);
-            return {id, _core.get()};
-        } else {
-            array_index index = _core->free_entities.back();
-            entity_id id = _core->entities[index];
-            _core->free_entities.pop_back();
-            _core->add_entity_to_archetype(id, empty_archetype);
-            return {id, _core.get()};
+        return {create_entity_in_archetype(_core->archetypes[_core->empty_archetype_index]), _core.get()};
+    }
+
+    // Creates count entities directly in the archetype for T..., each one constructed with a copy of components
+    template <typename... T>
+    std::vector<entity> create_entities(size_t count, const T&... components) {
+        reserve<T...>(count);
+        _::archetype& archetype = _core->get_or_create_archetype(_core->create_archetype_mask<T...>());
+        std::array<array_index, sizeof...(T)> component_indices = {
+            _::archetype_component_index(archetype, _core->lookup_component_id<T>())...};
+
+        std::vector<entity> entities;
+        entities.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            entity_id id = create_entity_in_archetype(archetype);
+            array_index row = _core->entity_archetypes[_::entity_id_index(id)].archetype_entity_index;
+            construct_components<T...>(archetype, id, row, component_indices, std::index_sequence_for<T...>(),
+                                       components...);
+            entities.push_back({id, _core.get()});
         }
+        return entities;
+    }
+
+    // Reserves room for count more entities, and for count more rows in the archetype for T... which is created now if
+    // it doesn't exist yet
+    template <typename... T>
+    void reserve(size_t count) {
+        size_t new_entities = count > _core->free_entities.size() ? count - _core->free_entities.size() : 0;
+        _core->entities.reserve(_core->entities.size() + new_entities);
+        _core->entity_archetypes.reserve(_core->entity_archetypes.size() + new_entities);
+
+        _::archetype& archetype = _core->get_or_create_archetype(_core->create_archetype_mask<T...>());
+        archetype.entities.reserve(archetype.entities.size() + count);
+        archetype.storage.reserve(archetype.storage.size() + count);
     }
 
+    // Destroys the entity along with its descendants
     void destroy_entity(class entity entity) {
         if (!entity.alive()) return;
-        _core->remove_entity_from_archetype(entity._id);
-        _core->free_entities.push_back(_::entity_id_index(entity._id));
-        entity_id new_id = _::create_entity_id(_::entity_id_index(entity._id), _::entity_id_version(entity._id) + 1);
-        _core->entities[_::entity_id_index(entity._id)] = new_id;
+        if (_core->entity_in_hierarchy(entity._id)) {
+            for (entity_id descendant : _core->remove_entity_hierarchy(entity._id))
+                destroy_entity_data(descendant);
+        }
+        destroy_entity_data(entity._id);
+    }
+
+    // Visits every entity with a parent one depth level at a time, calling func(entity, components..., parent's
+    // components...) for those where both the entity and its parent have every T. Parents are visited before their
+    // children so values can be propagated down the hierarchy. Each level is walked in storage order and spread across
+    // the workers, so func must not change the world structurally.
+    template <typename... T, typename F>
+    void propagate(F&& func) {
+        static_assert(sizeof...(T) > 0, "Nothing to propagate");
+        static_assert((... && !_::is_tag_component_v<std::remove_const_t<T>>), "Tag components have no storage");
+        std::array<component_id, sizeof...(T)> component_ids = {
+            _core->lookup_component_id<std::remove_const_t<T>>()...};
+        for (auto& level : _core->hierarchy_levels) {
+            _core->sort_hierarchy_level(level);
+            size_t batches = (level.size() + SATURN_ECS_HIERARCHY_BATCH_SIZE - 1) / SATURN_ECS_HIERARCHY_BATCH_SIZE;
+            _core->workers->run(batches, [&](size_t batch, size_t) {
+                size_t end = std::min(level.size(), (batch + 1) * SATURN_ECS_HIERARCHY_BATCH_SIZE);
+                for (size_t i = batch * SATURN_ECS_HIERARCHY_BATCH_SIZE; i < end; i++)
+                    propagate_entity<T...>(level[i], component_ids, func, std::index_sequence_for<T...>());
+            });
+
+            // Marked here rather than by the workers, which can share a chunk
+            if constexpr ((... || !std::is_const_v<T>)) {
+                for (entity_id entity : level)
+                    mark_propagated<T...>(entity, component_ids, std::index_sequence_for<T...>());
+            }
+        }
     }
 
     template <typename... T>
@@ -67,6 +153,9 @@ class world {
         return create_query_from_type<query<T...>>();
     }
 
+    // Systems of a stage whose terms don't conflict run concurrently, so they must record structural changes with
+    // ctx.commands() and only touch the components they declare. A system that does anything else, like setting
+    // components on entities directly, has to declare exclusive to run alone.
     template <typename... T, typename F>
     system_id create_system(stage stage, F&& func) {
         std::unique_ptr<_::system_base> system;
@@ -79,6 +168,7 @@ class world {
             static_assert(always_false_v<decltype(func)>, "Invalid system function signature");
         }
 
+        system->access = _::system_access_of<T...>::create(_core.get());
         return add_system(stage, std::move(system));
     }
 
@@ -91,17 +181,97 @@ class world {
     system_id create_system(stage stage = stages::update) {
         using struct_pointer_system_t = typename S::template forward_args_t<_::struct_ptr_system>;
         auto query = create_query_from_type<typename S::query_t>();
-        return add_system(stage, std::make_unique<struct_pointer_system_t>(query, std::make_unique<S>()));
+        auto system = std::make_unique<struct_pointer_system_t>(query, std::make_unique<S>());
+        system->access = S::template forward_args_t<_::system_access_of>::create(_core.get());
+        return add_system(stage, std::move(system));
     }
 
     void destroy_system(system_id system) {
         _systems.erase(system);
+        _command_buffers.erase(system);
         for (auto& [stage, systems] : _systems_by_stage) {
-            systems.erase(system);
+            if (systems.erase(system)) _stage_schedules.erase(stage);
         }
     }
 
+    // Calls func(entities) with the entities T was added to, removed from or destroyed with. Events are recorded into a
+    // buffer per component and delivered in batches after each stage, once its commands have been applied. Nothing is
+    // recorded for a component until it has an observer.
+    template <typename T, typename F>
+    observer_id create_observer(observer_event event, F&& func) {
+        observer_id id = _core->create_observer_id();
+        _observers.emplace(id, _::observer {.component = _core->lookup_component_id<T>(),
+                                            .event = event,
+                                            .func = std::forward<F>(func)});
+        update_observed_components();
+        return id;
+    }
+
+    void destroy_observer(observer_id observer) {
+        if (_observers.erase(observer)) update_observed_components();
+    }
+
+    // Stores the resource in the world, replacing its current T
+    template <typename T>
+    T& insert_resource(T resource) {
+        static_assert(!std::is_const_v<T>, "Can't insert const resources");
+        _::type_index index = _::lookup_resource_index<T>();
+        if (_core->resources.size() <= index) _core->resources.resize(index + 1);
+        _core->resources[index] = std::make_shared<T>(std::move(resource));
+        return *(T*) _core->resources[index].get();
+    }
+
+    template <typename T>
+    void remove_resource() {
+        _::type_index index = _::lookup_resource_index<std::remove_const_t<T>>();
+        if (index < _core->resources.size()) _core->resources[index].reset();
+    }
+
+    template <typename T>
+    [[nodiscard]] bool has_resource() {
+        return _core->find_resource<T>() != nullptr;
+    }
+
+    template <typename T>
+    [[nodiscard]] T& resource() {
+        T* resource = _core->find_resource<T>();
+        if (!resource) throw std::runtime_error("Resource does not exist");
+        return *resource;
+    }
+
+    // Releases the memory the world holds on to but doesn't use: chunks and sparse set pages past the last component,
+    // the storage of empty archetypes, and spare capacity in the entity, hierarchy, observer and command tables.
+    // Storage is always kept dense, so no component moves and component handles stay valid.
+    void compact() {
+        for (auto& archetype : _core->archetypes)
+            _core->compact_archetype(archetype, 0);
+        for (component_id component : _core->sparse_components)
+            _core->find_sparse_set(component)->shrink_to_fit();
+        _core->compact_tables();
+
+        for (auto& events : _delivered_observer_events) {
+            for (auto& entities : events)
+                entities.shrink_to_fit();
+        }
+        _observed_entities.shrink_to_fit();
+        for (auto& [system, command_buffers] : _command_buffers) {
+            for (auto& commands : command_buffers)
+                commands->shrink_to_fit();
+        }
+    }
+
+    // Compacts up to count archetypes and sparse sets at the end of every update, continuing where the previous update
+    // stopped. They keep SATURN_ECS_COMPACTION_SPARE_CHUNKS chunks to grow into. Zero, the default, turns it off.
+    void set_compaction_budget(size_t count) {
+        _compaction_budget = count;
+    }
+
+    [[nodiscard]] world_tick tick() const {
+        return _core->tick;
+    }
+
     void update() {
+        _core->tick++;
         _current_update_time = std::chrono::high_resolution_clock::now();
         _update_dt = std::chrono::duration_cast<std::chrono::duration<delta_time, delta_time_period>>(
                          _current_update_time - _last_update_time)
@@ -111,9 +281,105 @@ class world {
         update_stage(stages::pre_update);
         update_stage(stages::update);
         update_stage(stages::post_update);
+        if (_compaction_budget) compact_incrementally();
     }
 
   private:
+    // An entity's commands from a command buffer, merged so they can be applied with a single archetype move
+    struct entity_commands {
+        entity_id entity;
+        array_index archetype_index;
+        archetype_mask mask;
+        // Indices of the set commands that survive the merge
+        std::vector<array_index> sets;
+        // Sparse components to remove, they are removed before the sets are applied
+        std::vector<component_id> sparse_removes;
+        bool destroyed;
+    };
+
+    void destroy_entity_data(entity_id entity) {
+        if (_core->has_observers) {
+            auto archetype_index = _core->entity_archetypes[_::entity_id_index(entity)].archetype_index;
+            const archetype_mask& mask = _core->archetypes[archetype_index].mask;
+            _core->record_observer_event(observer_event::destroyed, entity, mask, {});
+        }
+        if (!_core->sparse_components.empty()) _core->destroy_entity_sparse_components(entity);
+        _core->remove_entity_from_archetype(entity);
+        _core->free_entities.push_back(_::entity_id_index(entity));
+        entity_id new_id = _::create_entity_id(_::entity_id_index(entity), _::entity_id_version(entity) + 1);
+        _core->entities[_::entity_id_index(entity)] = new_id;
+    }
+
+    template <typename... T, typename F, size_t... I>
+    void propagate_entity(entity_id entity, const std::array<component_id, sizeof...(T)>& component_ids, F& func,
+                          std::index_sequence<I...>) {
+        entity_id parent = _core->hierarchy[_::entity_id_index(entity)].parent;
+        std::array<void*, sizeof...(T)> components = {_core->entity_component(entity, component_ids[I])...};
+        std::array<void*, sizeof...(T)> parent_components = {_core->entity_component(parent, component_ids[I])...};
+        if ((... || !components[I]) || (... || !parent_components[I])) return;
+
+        func(saturn::entity(entity, _core.get()), *(T*) components[I]...,
+             *(const std::remove_const_t<T>*) parent_components[I]...);
+    }
+
+    template <typename... T, size_t... I>
+    void mark_propagated(entity_id entity, const std::array<component_id, sizeof...(T)>& component_ids,
+                         std::index_sequence<I...>) {
+        auto& entity_archetype = _core->entity_archetypes[_::entity_id_index(entity)];
+        (..., (std::is_const_v<T> ? void() : _core->mark_component_changed(entity_archetype, component_ids[I])));
+    }
+
+    entity_id create_entity_in_archetype(_::archetype& archetype) {
+        if (_core->free_entities.empty()) {
+            entity_id id = _::create_entity_id(_core->entities.size(), 0);
+            _core->entities.push_back(id);
+            _core->entity_archetypes.push_back({_::archetype_id_index(archetype.id), 0});
+            _core->add_entity_to_archetype(id, archetype);
+            if (_core->has_observers) _core->record_observer_event(observer_event::added, id, archetype.mask, {});
+            return id;
+        } else {
+            array_index index = _core->free_entities.back();
+            entity_id id = _core->entities[index];
+            _core->free_entities.pop_back();
+            _core->add_entity_to_archetype(id, archetype);
+            if (_core->has_observers) _core->record_observer_event(observer_event::added, id, archetype.mask, {});
+            return id;
+        }
+    }
+
+    template <typename... T, size_t... I>
+    void construct_components(_::archetype& archetype, entity_id entity, array_index row,
+                              const std::array<array_index, sizeof...(T)>& component_indices, std::index_sequence<I...>,
+                              const T&... components) {
+        (..., construct_component<T>(archetype, entity, row, component_indices[I], components));
+    }
+
+    template <typename T>
+    void construct_component(_::archetype& archetype, entity_id entity, array_index row, array_index component_index,
+                             const T& component) {
+        if constexpr (_::is_sparse_component_v<T>) {
+            void* component_ptr = _core->add_sparse_component(entity, _core->lookup_component_id<T>());
+            if constexpr (!_::is_tag_component_v<T>) new (component_ptr) T(component);
+        } else if constexpr (!_::is_tag_component_v<T>) {
+            new (archetype.storage.component(component_index, row)) T(component);
+            archetype.storage.mark_added(component_index, row, _core->tick);
+        }
+    }
+
+    void compact_incrementally() {
+        size_t count = _core->archetypes.size() + _core->sparse_components.size();
+        for (size_t i = 0; i < std::min(_compaction_budget, count); i++) {
+            size_t index = _compaction_cursor++ % count;
+            if (index < _core->archetypes.size()) {
+                _core->compact_archetype(_core->archetypes[index], SATURN_ECS_COMPACTION_SPARE_CHUNKS);
+            } else {
+                component_id component = _core->sparse_components[index - _core->archetypes.size()];
+                _core->find_sparse_set(component)->shrink_to_fit(SATURN_ECS_COMPACTION_SPARE_CHUNKS);
+            }
+        }
+        _compaction_cursor %= count;
+    }
+
     // TODO: Not sure how to improve this
     template <typename T>
     T create_query_from_type() {
@@ -124,13 +390,238 @@ class world {
         system_id id = _core->create_system_id();
         _systems[id] = std::move(system);
         _systems_by_stage[stage].insert(id);
+        _stage_schedules.erase(stage);
+        auto& command_buffers = _command_buffers[id];
+        for (size_t i = 0; i < _core->workers->size(); i++)
+            command_buffers.push_back(std::unique_ptr<command_buffer>(new command_buffer(_core.get())));
         return id;
     }
 
+    // Systems in a batch don't conflict with each other and run concurrently. Each system runs after every earlier
+    // created system it conflicts with, so the results are the same as running them one by one in creation order.
+    const std::vector<std::vector<system_id>>& stage_schedule(stage stage) {
+        auto it = _stage_schedules.find(stage);
+        if (it != _stage_schedules.end()) return it->second;
+
+        const auto& stage_systems = _systems_by_stage[stage];
+        std::vector<system_id> systems(stage_systems.begin(), stage_systems.end());
+        std::sort(systems.begin(), systems.end());
+
+        auto& schedule = _stage_schedules[stage];
+        std::vector<size_t> batches(systems.size());
+        for (size_t i = 0; i < systems.size(); i++) {
+            const _::system_access& access = _systems[systems[i]]->access;
+            batches[i] = 0;
+            for (size_t j = 0; j < i; j++) {
+                if (_::system_accesses_conflict(access, _systems[systems[j]]->access))
+                    batches[i] = std::max(batches[i], batches[j] + 1);
+            }
+            if (schedule.size() <= batches[i]) schedule.resize(batches[i] + 1);
+            schedule[batches[i]].push_back(systems[i]);
+        }
+        return schedule;
+    }
+
     void update_stage(stage stage) {
-        system_context ctx(_core.get(), _update_dt);
-        for (system_id id : _systems_by_stage[stage])
-            _systems[id]->run(ctx);
+        const auto& schedule = stage_schedule(stage);
+        for (const auto& batch : schedule) {
+            _core->workers->run(batch.size(), [&](size_t task, size_t) {
+                auto& system = _systems.find(batch[task])->second;
+                system_context ctx(_core.get(), _update_dt, &_command_buffers.find(batch[task])->second,
+                                   &system->access);
+                system->run(ctx);
+            });
+        }
+        // Commands are applied in creation order too, whichever batch the system ran in
+        std::vector<system_id> systems(_systems_by_stage[stage].begin(), _systems_by_stage[stage].end());
+        std::sort(systems.begin(), systems.end());
+        for (system_id id : systems) {
+            for (auto& commands : _command_buffers[id])
+                apply_commands(*commands);
+        }
+        deliver_observer_events();
+    }
+
+    void update_observed_components() {
+        _core->has_observers = !_observers.empty();
+        _core->observed_components = {};
+        for (const auto& [id, observer] : _observers) {
+            auto& observed = _core->observed_components[(size_t) observer.event];
+            observed = _::archetype_mask_add_component(observed, observer.component);
+        }
+
+        for (size_t event = 0; event < OBSERVER_EVENT_COUNT; event++) {
+            auto& events = _core->observer_events[event];
+            events.resize(SATURN_ECS_MAX_COMPONENTS);
+            _delivered_observer_events[event].resize(SATURN_ECS_MAX_COMPONENTS);
+            // Drop what was recorded for components nobody observes anymore
+            for (array_index i = 0; i < SATURN_ECS_MAX_COMPONENTS; i++) {
+                if (!_::archetype_mask_has_component(_core->observed_components[event], _::create_component_id(i)))
+                    events[i].clear();
+            }
+        }
+    }
+
+    // Hands every event recorded since the last delivery to the observers, in the order they were created. Events
+    // caused by the observers themselves are delivered next time.
+    void deliver_observer_events() {
+        if (!_core->has_observers) return;
+        std::swap(_delivered_observer_events, _core->observer_events);
+
+        // Observers can be created and destroyed from an observer, so look the next one up after each call
+        for (auto it = _observers.begin(); it != _observers.end();) {
+            observer_id id = it->first;
+            const auto& entities = _delivered_observer_events[(size_t) it->second.event]
+                                                             [_::component_id_bit_index(it->second.component)];
+            if (!entities.empty()) {
+                _observed_entities.clear();
+                for (entity_id entity : entities)
+                    _observed_entities.push_back({entity, _core.get()});
+                // Copied, so destroying the observer while it runs doesn't destroy the function being called
+                observer_func func = it->second.func;
+                func(_observed_entities);
+            }
+            it = _observers.upper_bound(id);
+        }
+
+        for (auto& events : _delivered_observer_events) {
+            for (auto& entities : events)
+                entities.clear();
+        }
+    }
+
+    // Applies every command in the buffer. Commands for an existing entity are merged and applied with one archetype
+    // move, visiting entities archetype by archetype. Created entities are grouped by the archetype they end up in.
+    void apply_commands(command_buffer& buffer) {
+        if (buffer.empty()) return;
+
+        std::vector<entity_commands> edits;
+        std::vector<entity_commands> creates;
+        std::unordered_map<entity_id, std::vector<array_index>> edit_commands;
+        std::vector<std::vector<array_index>> create_commands;
+        for (array_index i = 0; i < buffer._commands.size(); i++) {
+            const auto& command = buffer._commands[i];
+            if (command.type == command_buffer::command_type::create_entity) create_commands.emplace_back();
+            else if (command.entity == INVALID_ENTITY_ID) create_commands.back().push_back(i);
+            else if (_core->entity_alive(command.entity)) edit_commands[command.entity].push_back(i);
+        }
+
+        edits.reserve(edit_commands.size());
+        for (const auto& [entity, commands] : edit_commands) {
+            array_index archetype_index = _core->entity_archetypes[_::entity_id_index(entity)].archetype_index;
+            edits.push_back(merge_entity_commands(buffer, entity, archetype_index, commands));
+        }
+        std::sort(edits.begin(), edits.end(), [](const entity_commands& a, const entity_commands& b) {
+            return a.archetype_index < b.archetype_index;
+        });
+        for (const auto& edit : edits)
+            apply_entity_commands(buffer, edit);
+
+        creates.reserve(create_commands.size());
+        for (const auto& commands : create_commands)
+            creates.push_back(merge_entity_commands(buffer, INVALID_ENTITY_ID, _core->empty_archetype_index, commands));
+        for (auto& create : creates)
+            create.archetype_index = _::archetype_id_index(_core->get_or_create_archetype(create.mask).id);
+        std::stable_sort(creates.begin(), creates.end(), [](const entity_commands& a, const entity_commands& b) {
+            return a.archetype_index < b.archetype_index;
+        });
+        for (size_t i = 0; i < creates.size(); i++) {
+            _::archetype& archetype = _core->archetypes[creates[i].archetype_index];
+            if (i == 0 || creates[i - 1].archetype_index != creates[i].archetype_index) {
+                size_t count = 1;
+                while (i + count < creates.size() && creates[i + count].archetype_index == creates[i].archetype_index)
+                    count++;
+                archetype.entities.reserve(archetype.entities.size() + count);
+                archetype.storage.reserve(archetype.storage.size() + count);
+            }
+
+            entity_id id = create_entity_in_archetype(archetype);
+            apply_set_commands(buffer, id, {}, creates[i].sets);
+        }
+
+        buffer.clear();
+    }
+
+    // Folds an entity's commands in the order they were recorded, a later command for a component replaces any earlier
+    // one. Components of replaced set commands are left in the buffer, which destroys them when it's cleared.
+    entity_commands merge_entity_commands(command_buffer& buffer, entity_id entity, array_index archetype_index,
+                                          const std::vector<array_index>& commands) {
+        entity_commands merged {.entity = entity,
+                                .archetype_index = archetype_index,
+                                .mask = _core->archetypes[archetype_index].mask,
+                                .sets = {},
+                                .sparse_removes = {},
+                                .destroyed = false};
+        for (array_index i : commands) {
+            const auto& command = buffer._commands[i];
+            if (command.type == command_buffer::command_type::destroy_entity) {
+                merged.destroyed = true;
+                break;
+            }
+
+            std::erase_if(merged.sets, [&](array_index set) {
+                return buffer._commands[set].component == command.component;
+            });
+            bool sparse = _core->registry->info(command.component).sparse;
+            if (command.type == command_buffer::command_type::set_component) {
+                if (!sparse) merged.mask = _::archetype_mask_add_component(merged.mask, command.component);
+                merged.sets.push_back(i);
+            } else if (sparse) {
+                merged.sparse_removes.push_back(command.component);
+            } else {
+                merged.mask = _::archetype_mask_remove_component(merged.mask, command.component);
+            }
+        }
+        return merged;
+    }
+
+    void apply_entity_commands(command_buffer& buffer, const entity_commands& edit) {
+        // Destroying an entity earlier in the buffer destroys its descendants too
+        if (!_core->entity_alive(edit.entity)) return;
+        if (edit.destroyed) {
+            destroy_entity({edit.entity, _core.get()});
+            return;
+        }
+
+        array_index archetype_index = _core->entity_archetypes[_::entity_id_index(edit.entity)].archetype_index;
+        archetype_mask old_mask = _core->archetypes[archetype_index].mask;
+        auto& transition = _core->get_or_create_transition(archetype_index, edit.mask);
+        _core->move_entity_to_archetype(edit.entity, transition);
+        for (component_id component : edit.sparse_removes)
+            _core->remove_sparse_component(edit.entity, component);
+        apply_set_commands(buffer, edit.entity, old_mask, edit.sets);
+    }
+
+    // Moves the components out of the buffer into the entity, replacing the ones it had in old_mask
+    void apply_set_commands(command_buffer& buffer, entity_id entity, const archetype_mask& old_mask,
+                            const std::vector<array_index>& sets) {
+        _::entity_archetype& entity_archetype = _core->entity_archetypes[_::entity_id_index(entity)];
+        for (array_index i : sets) {
+            auto& command = buffer._commands[i];
+            if (_core->registry->info(command.component).sparse) {
+                apply_sparse_set_command(command, entity);
+                continue;
+            }
+            if (!command.data) continue;
+
+            void* component = _core->entity_archetype_component(entity_archetype, command.component);
+            bool replaced = _::archetype_mask_has_component(old_mask, command.component);
+            if (replaced) _core->destroy_component_data(command.component, component);
+            _core->relocate_component_data(command.component, component, command.data);
+            if (replaced) _core->mark_component_changed(entity_archetype, command.component);
+            else _core->mark_component_added(entity_archetype, command.component);
+            command.data = nullptr;
+        }
+    }
+
+    void apply_sparse_set_command(command_buffer::command& command, entity_id entity) {
+        bool replaced = _core->entity_has_sparse_component(entity, command.component);
+        void* component = replaced ? _core->find_sparse_set(command.component)->find(_::entity_id_index(entity))
+                                   : _core->add_sparse_component(entity, command.component);
+        if (!command.data) return;
+        if (replaced) _core->destroy_component_data(command.component, component);
+        _core->relocate_component_data(command.component, component, command.data);
+        command.data = nullptr;
     }
 };
 
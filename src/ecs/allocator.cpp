@@ -0,0 +1,104 @@
+#include "saturn/ecs/utils/allocator.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <sys/mman.h>
+
+namespace saturn {
+
+static size_t align(size_t offset, size_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Maps size bytes starting on an alignment boundary, over-mapping and unmapping the slack around it
+static void* map_aligned(size_t size, size_t alignment) {
+    size_t mapped_size = size + alignment;
+    void* mapping = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) throw std::bad_alloc();
+
+    uintptr_t start = align((uintptr_t) mapping, alignment);
+    size_t head = start - (uintptr_t) mapping;
+    if (head) munmap(mapping, head);
+    if (mapped_size - head - size) munmap((void*) (start + size), mapped_size - head - size);
+#ifdef MADV_HUGEPAGE
+    if (size >= SATURN_ECS_HUGE_PAGE_SIZE) madvise((void*) start, size, MADV_HUGEPAGE);
+#endif
+    return (void*) start;
+}
+
+void* heap_allocator::allocate(size_t size, size_t alignment) {
+    // Some platforms reject alignments smaller than a pointer, and aligned_alloc wants the size to be a multiple of it
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void* data = std::aligned_alloc(alignment, align(size, alignment));
+    if (!data) throw std::bad_alloc();
+    return data;
+}
+
+void heap_allocator::deallocate(void* data, size_t, size_t) {
+    std::free(data);
+}
+
+huge_page_allocator::huge_page_allocator(size_t region_size)
+    : _region_size(align(std::max<size_t>(region_size, 1), SATURN_ECS_HUGE_PAGE_SIZE)) { }
+
+huge_page_allocator::~huge_page_allocator() {
+    for (auto [region, size] : _regions)
+        munmap(region, size);
+}
+
+bool huge_page_allocator::owns_mapping(size_t size) const {
+    return size > _region_size / 4;
+}
+
+void* huge_page_allocator::allocate(size_t size, size_t alignment) {
+    size = align(size, alignment);
+    if (owns_mapping(size)) return map_aligned(align(size, SATURN_ECS_HUGE_PAGE_SIZE), SATURN_ECS_HUGE_PAGE_SIZE);
+
+    std::lock_guard lock(_mutex);
+    auto free_blocks = _free_blocks.find({size, alignment});
+    if (free_blocks != _free_blocks.end() && !free_blocks->second.empty()) {
+        void* data = free_blocks->second.back();
+        free_blocks->second.pop_back();
+        return data;
+    }
+
+    size_t offset = align(_region_offset, alignment);
+    if (_regions.empty() || offset + size > _regions.back().second) {
+        _regions.emplace_back(map_aligned(_region_size, SATURN_ECS_HUGE_PAGE_SIZE), _region_size);
+        offset = 0;
+    }
+    _region_offset = offset + size;
+    return (std::byte*) _regions.back().first + offset;
+}
+
+void huge_page_allocator::deallocate(void* data, size_t size, size_t alignment) {
+    size = align(size, alignment);
+    if (owns_mapping(size)) {
+        munmap(data, align(size, SATURN_ECS_HUGE_PAGE_SIZE));
+        return;
+    }
+
+    std::lock_guard lock(_mutex);
+    _free_blocks[{size, alignment}].push_back(data);
+}
+
+void* tracking_allocator::allocate(size_t size, size_t alignment) {
+    void* data = _upstream->allocate(size, alignment);
+    size_t allocated_bytes = _allocated_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    size_t peak_allocated_bytes = _peak_allocated_bytes.load(std::memory_order_relaxed);
+    while (peak_allocated_bytes < allocated_bytes &&
+           !_peak_allocated_bytes.compare_exchange_weak(peak_allocated_bytes, allocated_bytes,
+                                                        std::memory_order_relaxed))
+        ;
+    _allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return data;
+}
+
+void tracking_allocator::deallocate(void* data, size_t size, size_t alignment) {
+    _upstream->deallocate(data, size, alignment);
+    _allocated_bytes.fetch_sub(size, std::memory_order_relaxed);
+    _allocation_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+} // namespace saturn
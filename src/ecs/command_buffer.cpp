@@ -0,0 +1,53 @@
+#include "saturn/ecs/command_buffer.hpp"
+
+namespace saturn {
+
+command_buffer::~command_buffer() {
+    clear();
+    for (void* block : _blocks)
+        _core->memory->deallocate(block, SATURN_ECS_COMMAND_BLOCK_SIZE, SATURN_ECS_COLUMN_ALIGNMENT);
+}
+
+void* command_buffer::allocate(size_t size, size_t alignment) {
+    if (size > SATURN_ECS_COMMAND_BLOCK_SIZE || alignment > SATURN_ECS_COLUMN_ALIGNMENT) {
+        void* data = _core->memory->allocate(size, alignment);
+        _large_blocks.push_back({data, size, alignment});
+        return data;
+    }
+
+    size_t offset = (_current_block_offset + alignment - 1) & ~(alignment - 1);
+    if (_current_block == _blocks.size() || offset + size > SATURN_ECS_COMMAND_BLOCK_SIZE) {
+        if (_current_block < _blocks.size()) _current_block++;
+        if (_current_block == _blocks.size())
+            _blocks.push_back(_core->memory->allocate(SATURN_ECS_COMMAND_BLOCK_SIZE, SATURN_ECS_COLUMN_ALIGNMENT));
+        offset = 0;
+    }
+
+    _current_block_offset = offset + size;
+    return (std::byte*) _blocks[_current_block] + offset;
+}
+
+void command_buffer::clear() {
+    for (command& command : _commands) {
+        if (command.data) _core->destroy_component_data(command.component, command.data);
+    }
+    _commands.clear();
+
+    for (auto [data, size, alignment] : _large_blocks)
+        _core->memory->deallocate(data, size, alignment);
+    _large_blocks.clear();
+    _current_block = 0;
+    _current_block_offset = 0;
+}
+
+void command_buffer::shrink_to_fit() {
+    size_t used_blocks = _commands.empty() ? 0 : _current_block + 1;
+    for (size_t i = used_blocks; i < _blocks.size(); i++)
+        _core->memory->deallocate(_blocks[i], SATURN_ECS_COMMAND_BLOCK_SIZE, SATURN_ECS_COLUMN_ALIGNMENT);
+    _blocks.resize(std::min(used_blocks, _blocks.size()));
+    _blocks.shrink_to_fit();
+    _commands.shrink_to_fit();
+    _large_blocks.shrink_to_fit();
+}
+
+} // namespace saturn
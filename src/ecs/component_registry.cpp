@@ -0,0 +1,42 @@
+#include "saturn/ecs/component_registry.hpp"
+#include <stdexcept>
+
+namespace saturn {
+
+namespace _ {
+
+static std::atomic<type_index> next_type_index = 0;
+
+type_index create_type_index() {
+    return next_type_index.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace _
+
+component_registry::component_registry()
+    : _component_ids(new std::atomic<component_id>[SATURN_ECS_MAX_COMPONENT_TYPES]),
+      _component_infos(new _::component_info[SATURN_ECS_MAX_COMPONENTS]) {
+    for (size_t i = 0; i < SATURN_ECS_MAX_COMPONENT_TYPES; i++)
+        _component_ids[i].store(INVALID_COMPONENT_ID, std::memory_order_relaxed);
+}
+
+component_id component_registry::register_component(_::type_index type, const _::component_info& info) {
+    if (type >= SATURN_ECS_MAX_COMPONENT_TYPES)
+        throw std::runtime_error("Too many component types, increase SATURN_ECS_MAX_COMPONENT_TYPES");
+
+    std::lock_guard lock(_mutex);
+    component_id id = _component_ids[type].load(std::memory_order_relaxed);
+    if (id != INVALID_COMPONENT_ID) return id;
+
+    id = _component_count.load(std::memory_order_relaxed);
+    if (id >= SATURN_ECS_MAX_COMPONENTS)
+        throw std::runtime_error("Too many component types, increase SATURN_ECS_MAX_COMPONENTS");
+
+    // The info has to be written before the id is published so lock-free readers never see it half initialized
+    _component_infos[id] = info;
+    _component_count.store(id + 1, std::memory_order_release);
+    _component_ids[type].store(id, std::memory_order_release);
+    return id;
+}
+
+} // namespace saturn
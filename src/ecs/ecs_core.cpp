@@ -1,7 +1,14 @@
 #include "saturn/ecs/ecs_core.hpp"
+#include <bit>
 
 namespace saturn::_ {
 
+static std::atomic<type_index> next_resource_index = 0;
+
+type_index create_resource_index() {
+    return next_resource_index.fetch_add(1, std::memory_order_relaxed);
+}
+
 array_index entity_id_index(entity_id id) {
     return id & 0xFFFFFFFF;
 }
@@ -22,10 +29,6 @@ archetype_id create_archetype_id(array_index index) {
     return (archetype_id) index;
 }
 
-archetype_component_id create_archetype_component_id(archetype_id archetype, component_id component) {
-    return (archetype_component_id) archetype | ((archetype_component_id) component << 32);
-}
-
 array_index component_id_bit_index(component_id id) {
     return id & 0xFFFF;
 }
@@ -34,25 +37,76 @@ component_id create_component_id(array_index bit_index) {
     return (component_id) bit_index;
 }
 
-bool archetype_mask_matches(archetype_mask mask, archetype_mask other) {
-    return (mask & other) == other;
+bool archetype_mask_matches(const archetype_mask& mask, const archetype_mask& other) {
+    uint64_t missing = 0;
+    for (array_index i = 0; i < SATURN_ECS_ARCHETYPE_MASK_WORDS; i++)
+        missing |= other.words[i] & ~mask.words[i];
+    return !missing;
+}
+
+bool archetype_mask_intersects(const archetype_mask& mask, const archetype_mask& other) {
+    uint64_t shared = 0;
+    for (array_index i = 0; i < SATURN_ECS_ARCHETYPE_MASK_WORDS; i++)
+        shared |= mask.words[i] & other.words[i];
+    return shared;
 }
 
-bool archetype_mask_has_component(archetype_mask mask, component_id component) {
-    return mask & ((archetype_mask) 1 << component_id_bit_index(component));
+void archetype_masks_matching(const archetype_mask* masks, size_t count, const archetype_mask& other,
+                              const archetype_mask& exclude, std::vector<array_index>& matches) {
+    // Only compare the words the masks actually use, the rest can never cause a mismatch
+    array_index word_count = SATURN_ECS_ARCHETYPE_MASK_WORDS;
+    while (word_count && !other.words[word_count - 1] && !exclude.words[word_count - 1])
+        word_count--;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t mismatch = 0;
+        for (array_index j = 0; j < word_count; j++)
+            mismatch |= (other.words[j] & ~masks[i].words[j]) | (exclude.words[j] & masks[i].words[j]);
+        if (!mismatch) matches.push_back(i);
+    }
 }
 
-archetype_mask archetype_mask_add_component(archetype_mask mask, component_id component) {
-    return mask | ((archetype_mask) 1 << component_id_bit_index(component));
+bool archetype_mask_has_component(const archetype_mask& mask, component_id component) {
+    array_index bit_index = component_id_bit_index(component);
+    return mask.words[bit_index / 64] & ((uint64_t) 1 << (bit_index % 64));
 }
 
-archetype_mask archetype_mask_remove_component(archetype_mask mask, component_id component) {
-    return mask & ~((archetype_mask) 1 << component_id_bit_index(component));
+array_index archetype_mask_component_rank(const archetype_mask& mask, component_id component) {
+    array_index bit_index = component_id_bit_index(component);
+    array_index rank = 0;
+    for (array_index i = 0; i < bit_index / 64; i++)
+        rank += std::popcount(mask.words[i]);
+    return rank + std::popcount(mask.words[bit_index / 64] & (((uint64_t) 1 << (bit_index % 64)) - 1));
+}
+
+archetype_mask archetype_mask_add_component(const archetype_mask& mask, component_id component) {
+    archetype_mask result = mask;
+    array_index bit_index = component_id_bit_index(component);
+    result.words[bit_index / 64] |= (uint64_t) 1 << (bit_index % 64);
+    return result;
+}
+
+archetype_mask archetype_mask_remove_component(const archetype_mask& mask, component_id component) {
+    archetype_mask result = mask;
+    array_index bit_index = component_id_bit_index(component);
+    result.words[bit_index / 64] &= ~((uint64_t) 1 << (bit_index % 64));
+    return result;
+}
+
+size_t query_filter_hash::operator()(const query_filter& filter) const noexcept {
+    std::hash<archetype_mask> hash;
+    return hash(filter.include) * 31 ^ hash(filter.exclude);
 }
 
 stage_id ecs_core::next_stage_id = 0;
 system_id ecs_core::next_system_id = 0;
-std::vector<size_t> ecs_core::component_sizes = {};
-component_id ecs_core::next_component_id = 0;
+observer_id ecs_core::next_observer_id = 0;
+
+} // namespace saturn::_
 
-} // namespace saturn::_
\ No newline at end of file
+size_t std::hash<saturn::archetype_mask>::operator()(const saturn::archetype_mask& mask) const noexcept {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (uint64_t word : mask.words)
+        hash = (hash ^ word) * 0x100000001b3;
+    return hash;
+}
\ No newline at end of file
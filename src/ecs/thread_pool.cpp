@@ -0,0 +1,123 @@
+#include "saturn/ecs/utils/thread_pool.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace saturn {
+
+static thread_local const thread_pool* current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+thread_pool::thread_pool(size_t worker_count)
+    : _worker_count(std::max<size_t>(worker_count, 1)), _queues(new worker_queue[_worker_count]) { }
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _start.notify_all();
+    for (std::thread& thread : _threads)
+        thread.join();
+}
+
+size_t thread_pool::worker_index() const {
+    return current_pool == this ? current_worker : 0;
+}
+
+void thread_pool::run(size_t task_count, const task_func& func) {
+    if (!task_count) return;
+    if (current_pool == this || _worker_count == 1 || task_count == 1) {
+        size_t worker = worker_index();
+        for (size_t task = 0; task < task_count; task++)
+            func(task, worker);
+        return;
+    }
+
+    std::lock_guard run_lock(_run_mutex);
+    if (_threads.empty()) start_threads();
+
+    for (size_t worker = 0; worker < _worker_count; worker++) {
+        std::lock_guard lock(_queues[worker].mutex);
+        size_t end = task_count * (worker + 1) / _worker_count;
+        for (size_t task = task_count * worker / _worker_count; task < end; task++)
+            _queues[worker].tasks.push_back(task);
+    }
+
+    {
+        std::lock_guard lock(_mutex);
+        _func = &func;
+        _busy_threads = _threads.size();
+        _batch++;
+    }
+    _start.notify_all();
+
+    const thread_pool* previous_pool = std::exchange(current_pool, this);
+    size_t previous_worker = std::exchange(current_worker, 0);
+    work(0);
+    current_pool = previous_pool;
+    current_worker = previous_worker;
+
+    std::unique_lock lock(_mutex);
+    _finished.wait(lock, [&] { return _busy_threads == 0; });
+    _func = nullptr;
+    if (_exception) std::rethrow_exception(std::exchange(_exception, nullptr));
+}
+
+void thread_pool::start_threads() {
+    _threads.reserve(_worker_count - 1);
+    for (size_t worker = 1; worker < _worker_count; worker++)
+        _threads.emplace_back(&thread_pool::thread_main, this, worker);
+}
+
+void thread_pool::thread_main(size_t worker) {
+    current_pool = this;
+    current_worker = worker;
+
+    uint64_t batch = 0;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _start.wait(lock, [&] { return _stopping || _batch != batch; });
+            if (_stopping) return;
+            batch = _batch;
+        }
+
+        work(worker);
+
+        std::lock_guard lock(_mutex);
+        if (--_busy_threads == 0) _finished.notify_all();
+    }
+}
+
+void thread_pool::work(size_t worker) {
+    size_t task;
+    while (pop_task(worker, task)) {
+        try {
+            (*_func)(task, worker);
+        } catch (...) {
+            std::lock_guard lock(_mutex);
+            if (!_exception) _exception = std::current_exception();
+        }
+    }
+}
+
+// Workers take their own tasks from the front so they walk their share in order, and steal from the back of the others
+bool thread_pool::pop_task(size_t worker, size_t& task) {
+    for (size_t i = 0; i < _worker_count; i++) {
+        worker_queue& queue = _queues[(worker + i) % _worker_count];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+
+        if (i == 0) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        } else {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+} // namespace saturn
@@ -0,0 +1,93 @@
+#include <catch2/catch_test_macros.hpp>
+#include <saturn/saturn.h>
+#include <string>
+
+struct allocator_position {
+    float x, y;
+};
+
+struct allocator_name {
+    std::string name;
+};
+
+struct allocator_effect {
+    int turns;
+};
+
+template <>
+struct saturn::sparse_component<allocator_effect> : std::true_type { };
+
+TEST_CASE("allocators", "[ecs]") {
+    auto universe = saturn::universe::create();
+
+    SECTION("tracking allocator reports the bytes of its world") {
+        auto memory = saturn::tracking_allocator::create();
+        auto other_memory = saturn::tracking_allocator::create();
+        auto world = universe->create_world(memory);
+        auto other_world = universe->create_world(other_memory);
+        REQUIRE(&world->memory() == memory.get());
+        size_t empty_bytes = memory->allocated_bytes();
+
+        auto entities = world->create_entities(10000, allocator_position {1, 2}, allocator_name {"tracked"});
+        for (size_t i = 0; i < entities.size(); i += 2)
+            entities[i].set<allocator_effect>({3});
+        size_t used_bytes = memory->allocated_bytes();
+        REQUIRE(used_bytes > empty_bytes + 10000 * (sizeof(allocator_position) + sizeof(allocator_name)));
+        REQUIRE(other_memory->allocated_bytes() < empty_bytes + SATURN_ECS_CHUNK_SIZE);
+
+        // Destroyed entities leave their storage allocated until the world is compacted
+        for (auto& entity : entities)
+            world->destroy_entity(entity);
+        REQUIRE(memory->allocated_bytes() >= used_bytes);
+        // Only the entity tables are left, their slots are kept so handles to destroyed entities stay dead
+        world->compact();
+        REQUIRE(memory->allocated_bytes() < used_bytes / 4);
+        REQUIRE(memory->peak_allocated_bytes() >= used_bytes);
+
+        world.reset();
+        REQUIRE(memory->allocated_bytes() == 0);
+        REQUIRE(memory->allocation_count() == 0);
+    }
+
+    SECTION("commands allocate from the world") {
+        auto memory = saturn::tracking_allocator::create();
+        auto world = universe->create_world(memory);
+        auto entity = world->create_entity();
+        entity.set<allocator_position>({1, 2});
+        world->create_system<allocator_position>([](auto& ctx, auto& query) {
+            for (auto [entity, position] : query)
+                ctx.commands().set(entity, allocator_name {"commanded"});
+        });
+        world->update();
+        REQUIRE(entity.get<allocator_name>().get()->name == "commanded");
+
+        world.reset();
+        REQUIRE(memory->allocated_bytes() == 0);
+    }
+
+    SECTION("huge page allocator") {
+        auto memory = saturn::huge_page_allocator::create();
+        auto world = universe->create_world(saturn::tracking_allocator::create(memory));
+        auto entities = world->create_entities(100000, allocator_position {1, 2}, allocator_name {"huge"});
+        for (size_t i = 0; i < entities.size(); i += 3)
+            entities[i].set<allocator_effect>({(int) i});
+
+        size_t count = 0;
+        for (auto [entity, position, name] : world->create_query<allocator_position, allocator_name>()) {
+            REQUIRE(position.x == 1);
+            REQUIRE(name.name == "huge");
+            count++;
+        }
+        REQUIRE(count == entities.size());
+        REQUIRE(world->create_query<allocator_effect>().count() == (entities.size() + 2) / 3);
+        REQUIRE(entities[3].get<allocator_effect>().get()->turns == 3);
+
+        // Freed memory is reused by later allocations of the same size
+        for (size_t i = 0; i < entities.size(); i += 2)
+            world->destroy_entity(entities[i]);
+        world->compact();
+        auto created = world->create_entities(50000, allocator_position {3, 4}, allocator_name {"again"});
+        REQUIRE(created.back().get<allocator_position>().get()->x == 3);
+        REQUIRE(world->create_query<allocator_position>().count() == 100000);
+    }
+}
@@ -0,0 +1,171 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <saturn/saturn.h>
+
+// Benchmarks are hidden from the default run, use `saturn-tests [benchmark]` to run them
+
+namespace {
+
+struct benchmark_position {
+    float x, y, z;
+};
+
+struct benchmark_velocity {
+    float x, y, z;
+};
+
+struct benchmark_health {
+    int health;
+};
+
+struct benchmark_buff {
+    int turns;
+};
+
+struct benchmark_sparse_buff {
+    int turns;
+};
+
+} // namespace
+
+template <>
+struct saturn::sparse_component<benchmark_sparse_buff> : std::true_type { };
+
+TEST_CASE("component access benchmark", "[.][benchmark]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+
+    std::vector<saturn::entity> entities;
+    for (int i = 0; i < 10000; i++) {
+        auto entity = world->create_entity();
+        entity.set<benchmark_position>({(float) i, 0, 0});
+        if (i % 2 == 0) entity.set<benchmark_velocity>({1, 0, 0});
+        if (i % 3 == 0) entity.set<benchmark_health>({100});
+        entities.push_back(entity);
+    }
+
+    std::vector<saturn::component<benchmark_position>> positions;
+    for (auto& entity : entities)
+        positions.push_back(entity.get<benchmark_position>().get());
+
+    BENCHMARK("entity.get<T>()") {
+        float sum = 0;
+        for (auto& entity : entities)
+            sum += entity.get<benchmark_position>().get()->x;
+        return sum;
+    };
+
+    BENCHMARK("component<T>::operator->") {
+        float sum = 0;
+        for (auto& position : positions)
+            sum += position->x;
+        return sum;
+    };
+
+    BENCHMARK("entity.try_get<T>()") {
+        float sum = 0;
+        for (auto& entity : entities)
+            sum += entity.try_get<const benchmark_position>()->x;
+        return sum;
+    };
+}
+
+TEST_CASE("parallel query benchmark", "[.][benchmark]") {
+    size_t max_workers = std::max(std::thread::hardware_concurrency(), 1u);
+    for (size_t workers = 1; workers <= max_workers; workers *= 2) {
+        saturn::world world(saturn::component_registry::create(), saturn::thread_pool::create(workers));
+        world.create_entities<benchmark_position, benchmark_velocity>(1000000, {0, 0, 0}, {1, 2, 3});
+        auto query = world.create_query<benchmark_position, const benchmark_velocity>();
+
+        BENCHMARK("par_each over 1M entities with " + std::to_string(workers) + " workers") {
+            query.par_each([](const saturn::entity& entity, benchmark_position& position,
+                              const benchmark_velocity& velocity) {
+                position.x += velocity.x * 0.016f;
+                position.y += velocity.y * 0.016f;
+                position.z += velocity.z * 0.016f;
+            });
+        };
+
+        BENCHMARK("par_reduce over 1M entities with " + std::to_string(workers) + " workers") {
+            return query.par_reduce(
+                0.0f,
+                [](float& sum, const saturn::entity& entity, const benchmark_position& position,
+                   const benchmark_velocity& velocity) { sum += position.x * velocity.x; },
+                [](float& sum, float worker_sum) { sum += worker_sum; });
+        };
+    }
+}
+
+TEST_CASE("query iteration benchmark", "[.][benchmark]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    world->create_entities<benchmark_position, benchmark_velocity>(100000, {0, 0, 0}, {1, 2, 3});
+    auto query = world->create_query<benchmark_position, const benchmark_velocity>();
+
+    BENCHMARK("for (auto [entity, position, velocity] : query)") {
+        for (auto [entity, position, velocity] : query) {
+            position.x += velocity.x * 0.016f;
+            position.y += velocity.y * 0.016f;
+            position.z += velocity.z * 0.016f;
+        }
+    };
+
+    BENCHMARK("query.each_chunk") {
+        query.each_chunk([](const auto& chunk) {
+            auto positions = chunk.template components<benchmark_position>();
+            auto velocities = chunk.template components<benchmark_velocity>();
+            for (size_t i = 0; i < chunk.size(); i++) {
+                positions[i].x += velocities[i].x * 0.016f;
+                positions[i].y += velocities[i].y * 0.016f;
+                positions[i].z += velocities[i].z * 0.016f;
+            }
+        });
+    };
+}
+
+TEST_CASE("hierarchy propagation benchmark", "[.][benchmark]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    auto entities = world->create_entities<benchmark_position>(100000, {1, 1, 1});
+    for (size_t i = 1; i < entities.size(); i++)
+        entities[i].set_parent(entities[(i - 1) / 8]);
+
+    BENCHMARK("propagate over 100k entities") {
+        world->propagate<benchmark_position>([](const saturn::entity& entity, benchmark_position& position,
+                                                const benchmark_position& parent_position) {
+            position.x = parent_position.x + 1;
+            position.y = parent_position.y + 1;
+            position.z = parent_position.z + 1;
+        });
+    };
+
+    BENCHMARK("entity.get<T>() on the parent of 100k entities") {
+        for (size_t i = 1; i < entities.size(); i++) {
+            auto position = entities[i].get<benchmark_position>().get();
+            auto parent_position = entities[i].parent().get<benchmark_position>().get();
+            position->x = parent_position->x + 1;
+            position->y = parent_position->y + 1;
+            position->z = parent_position->z + 1;
+        }
+    };
+}
+
+TEST_CASE("component churn benchmark", "[.][benchmark]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    auto entities = world->create_entities(10000, benchmark_position {}, benchmark_velocity {}, benchmark_health {});
+
+    BENCHMARK("add and remove an archetype component on 10k entities") {
+        for (auto& entity : entities)
+            entity.set<benchmark_buff>({1});
+        for (auto& entity : entities)
+            entity.remove<benchmark_buff>();
+    };
+
+    BENCHMARK("add and remove a sparse component on 10k entities") {
+        for (auto& entity : entities)
+            entity.set<benchmark_sparse_buff>({1});
+        for (auto& entity : entities)
+            entity.remove<benchmark_sparse_buff>();
+    };
+}
@@ -40,3 +40,54 @@ TEST_CASE("component", "[ecs]") {
         REQUIRE(component != component_2);
     }
 }
+
+TEST_CASE("component access", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    auto entity = world->create_entity();
+    auto component = entity.set<component_a>({1}).get();
+
+    SECTION("try_get returns null instead of throwing") {
+        REQUIRE(entity.try_get<component_a>()->a == 1);
+        REQUIRE(entity.try_get<const component_a>() == entity.try_get<component_a>());
+        REQUIRE(entity.try_get<component_b>() == nullptr);
+        REQUIRE(component.try_get() == entity.try_get<component_a>());
+
+        world->destroy_entity(entity);
+        REQUIRE(entity.try_get<component_a>() == nullptr);
+        REQUIRE(component.try_get() == nullptr);
+        REQUIRE_THROWS(component->a);
+    }
+
+    SECTION("handles follow the component when it moves") {
+        auto other = world->create_entity();
+        other.set<component_a>({2});
+        auto other_component = other.get<component_a>().get();
+        REQUIRE(other_component->a == 2);
+
+        // Destroying the first entity moves the other into its row, then adding a component moves it to a new
+        // archetype
+        world->destroy_entity(entity);
+        REQUIRE(other_component->a == 2);
+        REQUIRE(&*other_component == other.try_get<component_a>());
+        other.set<component_b>({3});
+        REQUIRE(other_component->a == 2);
+        REQUIRE(&*other_component == other.try_get<component_a>());
+
+        other.remove<component_a>();
+        REQUIRE(other_component.try_get() == nullptr);
+        REQUIRE_THROWS(other_component->a);
+        other.set<component_a>({4});
+        REQUIRE(other_component->a == 4);
+    }
+
+    SECTION("cached access still counts as a write") {
+        auto changed = world->create_query<saturn::changed<component_a>>();
+        REQUIRE(component->a == 1);
+        REQUIRE(changed.count() == 1);
+        for (auto [e] : changed) { }
+        REQUIRE(changed.count() == 0);
+        component->a = 5;
+        REQUIRE(changed.count() == 1);
+    }
+}
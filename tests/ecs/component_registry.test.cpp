@@ -0,0 +1,96 @@
+#include <catch2/catch_test_macros.hpp>
+#include <saturn/saturn.h>
+#include <thread>
+
+struct registry_component_a {
+    int a;
+};
+
+struct registry_component_b {
+    int b;
+};
+
+struct registry_component_c {
+    int c;
+};
+
+template <int N>
+struct registry_numbered_component {
+    int value;
+};
+
+template <int... N>
+void register_numbered_components(saturn::component_registry& registry, std::integer_sequence<int, N...>) {
+    (registry.id<registry_numbered_component<N>>(), ...);
+}
+
+TEST_CASE("component registry", "[ecs]") {
+    auto registry = saturn::component_registry::create();
+
+    SECTION("register components in order") {
+        registry->register_components<registry_component_a, registry_component_b>();
+        REQUIRE(registry->id<registry_component_a>() == 0);
+        REQUIRE(registry->id<registry_component_b>() == 1);
+        REQUIRE(registry->size() == 2);
+    }
+
+    SECTION("const components share an id") {
+        REQUIRE(registry->id<registry_component_a>() == registry->id<const registry_component_a>());
+    }
+
+    SECTION("ids do not depend on other registries") {
+        auto other = saturn::component_registry::create();
+        other->register_components<registry_component_b, registry_component_a>();
+        registry->register_components<registry_component_a, registry_component_b>();
+        REQUIRE(registry->id<registry_component_a>() == 0);
+        REQUIRE(other->id<registry_component_a>() == 1);
+    }
+
+    SECTION("register components from multiple threads") {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<saturn::component_id>> ids(8);
+        for (int i = 0; i < 8; i++) {
+            threads.emplace_back([&, i]() {
+                ids[i].push_back(registry->id<registry_component_a>());
+                ids[i].push_back(registry->id<registry_component_b>());
+                ids[i].push_back(registry->id<registry_component_c>());
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+
+        REQUIRE(registry->size() == 3);
+        for (const auto& thread_ids : ids) {
+            REQUIRE(thread_ids == ids[0]);
+            REQUIRE(thread_ids[0] != thread_ids[1]);
+            REQUIRE(thread_ids[1] != thread_ids[2]);
+        }
+    }
+
+    SECTION("register too many components") {
+        register_numbered_components(*registry, std::make_integer_sequence<int, SATURN_ECS_MAX_COMPONENTS>());
+        REQUIRE_THROWS(registry->id<registry_component_a>());
+    }
+}
+
+TEST_CASE("component registry in a universe", "[ecs]") {
+    auto universe = saturn::universe::create();
+    universe->registry().register_components<registry_component_c, registry_component_b>();
+
+    SECTION("worlds share the universe registry") {
+        auto world_1 = universe->create_world();
+        auto world_2 = universe->create_world();
+        REQUIRE(&world_1->registry() == &universe->registry());
+        REQUIRE(&world_2->registry() == &universe->registry());
+        REQUIRE(world_1->registry().id<registry_component_c>() == 0);
+        REQUIRE(world_2->registry().id<registry_component_b>() == 1);
+    }
+
+    SECTION("worlds with an isolated registry") {
+        auto isolated_world = universe->create_world(saturn::component_registry::create());
+        auto entity = isolated_world->create_entity();
+        entity.set<registry_component_a>({5});
+        REQUIRE(isolated_world->registry().id<registry_component_a>() == 0);
+        REQUIRE(entity.get<registry_component_a>().get()->a == 5);
+    }
+}
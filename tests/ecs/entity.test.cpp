@@ -29,6 +29,29 @@ struct component_complex {
         : str(std::move(str)), vec(std::move(vec)), num(num), c(c) { }
 };
 
+struct component_tag {};
+
+struct component_lifecycle {
+    static inline int alive = 0;
+    std::string str;
+    component_lifecycle() : str(64, 'x') {
+        alive++;
+    }
+    explicit component_lifecycle(std::string str) : str(std::move(str)) {
+        alive++;
+    }
+    component_lifecycle(const component_lifecycle& other) : str(other.str) {
+        alive++;
+    }
+    component_lifecycle(component_lifecycle&& other) noexcept : str(std::move(other.str)) {
+        alive++;
+    }
+    component_lifecycle& operator=(const component_lifecycle& other) = default;
+    ~component_lifecycle() {
+        alive--;
+    }
+};
+
 TEST_CASE("entity", "[ecs]") {
     auto universe = saturn::universe::create();
     auto world = universe->create_world();
@@ -231,6 +254,81 @@ TEST_CASE("entity", "[ecs]") {
         REQUIRE(entity.get<component_b>().get()->b == test_b_1.b);
     }
 
+    SECTION("add and remove components back and forth") {
+        entity.set<component_a>(test_a_1).get();
+        for (int i = 0; i < 3; i++) {
+            entity.set<component_b>(component_b(i)).get();
+            entity.remove<component_a>();
+            entity.set<component_a>(component_a(i)).get();
+            entity.remove<component_b>();
+            REQUIRE(entity.get<component_a>().get()->a == i);
+            REQUIRE(!entity.has<component_b>());
+        }
+    }
+
+    SECTION("component address is stable while other entities are added") {
+        auto component = entity.set<component_a>(test_a_1).get();
+        component_a* address = &*component;
+        for (int i = 0; i < 10000; i++)
+            world->create_entity().set<component_a>(component_a(i));
+        REQUIRE(&*component == address);
+        REQUIRE(component->a == test_a_1.a);
+    }
+
+    SECTION("add a tag component") {
+        entity.set<component_a>(test_a_1).get();
+        REQUIRE_NOTHROW(entity.add<component_tag>().get());
+        REQUIRE(entity.has<component_tag>());
+        REQUIRE(entity.add<component_tag>().is_err());
+        REQUIRE(entity.get<component_a>().get()->a == test_a_1.a);
+        REQUIRE_NOTHROW(*entity.get<component_tag>().get());
+    }
+
+    SECTION("set and remove a tag component") {
+        entity.set<component_a>(test_a_1).get();
+        entity.set<component_tag>({}).get();
+        entity.remove<component_tag>();
+        REQUIRE(!entity.has<component_tag>());
+        REQUIRE(entity.get<component_a>().get()->a == test_a_1.a);
+    }
+
+    SECTION("set multiple components") {
+        auto [a, b] = entity.set(test_a_1, test_b_1).get();
+        REQUIRE(a->a == test_a_1.a);
+        REQUIRE(b->b == test_b_1.b);
+        REQUIRE(entity.has<component_a>());
+        REQUIRE(entity.has<component_b>());
+    }
+
+    SECTION("set multiple components that already exist") {
+        entity.set<component_a>(test_a_1).get();
+        entity.set<component_a, component_b>(test_a_2, test_b_1).get();
+        REQUIRE(entity.get<component_a>().get()->a == test_a_2.a);
+        REQUIRE(entity.get<component_b>().get()->b == test_b_1.b);
+    }
+
+    SECTION("remove multiple components") {
+        entity.set(test_a_1, test_b_1, test_complex_1).get();
+        entity.remove<component_a, component_b>();
+        REQUIRE(!entity.has<component_a>());
+        REQUIRE(!entity.has<component_b>());
+        REQUIRE(entity.get<component_complex>().get()->str == test_complex_1.str);
+    }
+
+    SECTION("remove and set components") {
+        entity.set(test_a_1, test_b_1).get();
+        auto [complex] = entity.remove_and_set<component_a>(test_complex_1).get();
+        REQUIRE(!entity.has<component_a>());
+        REQUIRE(entity.get<component_b>().get()->b == test_b_1.b);
+        REQUIRE(complex->str == test_complex_1.str);
+    }
+
+    SECTION("remove and set the same component") {
+        entity.set<component_a>(test_a_1).get();
+        entity.remove_and_set<component_a>(test_a_2).get();
+        REQUIRE(entity.get<component_a>().get()->a == test_a_2.a);
+    }
+
     SECTION("remove a missing component") {
         REQUIRE_NOTHROW(entity.remove<component_a>());
     }
@@ -417,6 +515,67 @@ TEST_CASE("multiple entities", "[ecs]") {
     }
 }
 
+TEST_CASE("component lifecycle", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    auto entity = world->create_entity();
+    entity.add<component_lifecycle>();
+    REQUIRE(component_lifecycle::alive == 1);
+
+    SECTION("move to another archetype") {
+        entity.add<component_a>();
+        REQUIRE(component_lifecycle::alive == 1);
+        REQUIRE(entity.get<component_lifecycle>().get()->str == std::string(64, 'x'));
+    }
+
+    SECTION("remove component") {
+        entity.remove<component_lifecycle>();
+        REQUIRE(component_lifecycle::alive == 0);
+    }
+
+    SECTION("remove components with a single move") {
+        entity.set(component_a(1), component_b(2)).get();
+        entity.remove<component_lifecycle, component_a>();
+        REQUIRE(component_lifecycle::alive == 0);
+        REQUIRE(entity.get<component_b>().get()->b == 2);
+    }
+
+    SECTION("remove a different component") {
+        entity.add<component_a>();
+        entity.remove<component_a>();
+        REQUIRE(component_lifecycle::alive == 1);
+        REQUIRE(entity.get<component_lifecycle>().get()->str == std::string(64, 'x'));
+    }
+
+    SECTION("destroy entity") {
+        world->destroy_entity(entity);
+        REQUIRE(component_lifecycle::alive == 0);
+    }
+
+    SECTION("destroy entities in the middle of an archetype") {
+        std::vector<saturn::entity> entities;
+        for (int i = 0; i < 100; i++) {
+            entities.push_back(world->create_entity());
+            entities.back().add<component_lifecycle>(std::string(64, 'a') + std::to_string(i));
+        }
+        for (int i = 0; i < 100; i += 2)
+            world->destroy_entity(entities[i]);
+        REQUIRE(component_lifecycle::alive == 51);
+        for (int i = 1; i < 100; i += 2)
+            REQUIRE(entities[i].get<component_lifecycle>().get()->str == std::string(64, 'a') + std::to_string(i));
+    }
+
+    SECTION("destroy world") {
+        for (int i = 0; i < 100; i++)
+            world->create_entity().add<component_lifecycle>();
+        world.reset();
+        REQUIRE(component_lifecycle::alive == 0);
+    }
+
+    world.reset();
+    REQUIRE(component_lifecycle::alive == 0);
+}
+
 TEST_CASE("destroyed entity", "[ecs]") {
     auto universe = saturn::universe::create();
     auto world = universe->create_world();
@@ -436,6 +595,14 @@ TEST_CASE("destroyed entity", "[ecs]") {
         REQUIRE_NOTHROW(entity.remove<component_a>());
     }
 
+    SECTION("set multiple components") {
+        REQUIRE(entity.set<component_a, component_b>({}, {}).is_err());
+    }
+
+    SECTION("remove multiple components") {
+        REQUIRE_NOTHROW(entity.remove<component_a, component_b>());
+    }
+
     SECTION("get component") {
         REQUIRE(entity.get<component_a>().is_err());
     }
@@ -0,0 +1,111 @@
+#include <catch2/catch_test_macros.hpp>
+#include <saturn/saturn.h>
+
+struct observed_component {
+    int value;
+};
+
+struct unobserved_component {
+    int value;
+};
+
+struct observed_tag {};
+
+TEST_CASE("observer", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+
+    std::vector<saturn::entity_id> added;
+    std::vector<saturn::entity_id> removed;
+    std::vector<saturn::entity_id> destroyed;
+    size_t batches = 0;
+    auto record = [&](std::vector<saturn::entity_id>& events) {
+        return [&](std::span<const saturn::entity> entities) {
+            batches++;
+            for (const auto& entity : entities)
+                events.push_back(entity.id());
+        };
+    };
+    world->create_observer<observed_component>(saturn::observer_event::added, record(added));
+    world->create_observer<observed_component>(saturn::observer_event::removed, record(removed));
+    world->create_observer<observed_component>(saturn::observer_event::destroyed, record(destroyed));
+
+    SECTION("events are delivered in batches when the world updates") {
+        std::vector<saturn::entity> entities;
+        for (int i = 0; i < 10; i++) {
+            auto entity = world->create_entity();
+            entity.set<observed_component>({i});
+            entity.set<unobserved_component>({i});
+            entities.push_back(entity);
+        }
+        REQUIRE(added.empty());
+
+        world->update();
+        REQUIRE(batches == 1);
+        REQUIRE(added.size() == 10);
+        for (int i = 0; i < 10; i++)
+            REQUIRE(added[i] == entities[i].id());
+
+        // Replacing a component isn't an addition
+        entities[0].set<observed_component>({100});
+        entities[1].remove<observed_component>();
+        world->destroy_entity(entities[2]);
+        world->destroy_entity(entities[3]);
+        world->update();
+        REQUIRE(added.size() == 10);
+        REQUIRE(removed == std::vector<saturn::entity_id> {entities[1].id()});
+        REQUIRE(destroyed == std::vector<saturn::entity_id> {entities[2].id(), entities[3].id()});
+
+        world->update();
+        REQUIRE(batches == 3);
+    }
+
+    SECTION("entities created with their components are observed") {
+        auto entities = world->create_entities<observed_component>(5, {0});
+        world->create_entities<unobserved_component>(5, {0});
+        world->update();
+        REQUIRE(added.size() == 5);
+    }
+
+    SECTION("changes recorded by systems are observed after their stage") {
+        auto entity = world->create_entity();
+        world->create_system<const unobserved_component>(
+            saturn::stages::pre_update, [&](saturn::system_context& ctx, auto& query) {
+                for (const auto& [entity, component] : query)
+                    ctx.commands().set<observed_component>(entity, {component.value});
+            });
+        size_t added_before_update = 0;
+        world->create_system<const observed_component>([&](auto& query) { added_before_update = added.size(); });
+        entity.set<unobserved_component>({1});
+
+        world->update();
+        REQUIRE(added == std::vector<saturn::entity_id> {entity.id()});
+        REQUIRE(added_before_update == 1);
+    }
+
+    SECTION("destroyed observers stop receiving events") {
+        auto observer = world->create_observer<observed_tag>(saturn::observer_event::added, record(added));
+        world->create_entity().add<observed_tag>();
+        world->destroy_observer(observer);
+        world->update();
+        REQUIRE(added.empty());
+
+        world->create_entity().add<observed_tag>();
+        world->update();
+        REQUIRE(added.empty());
+    }
+
+    SECTION("observers can change the world") {
+        world->create_observer<observed_component>(saturn::observer_event::added,
+                                                   [&](std::span<const saturn::entity> entities) {
+                                                       for (auto entity : entities)
+                                                           entity.remove<observed_component>();
+                                                   });
+        auto entity = world->create_entity();
+        entity.set<observed_component>({0});
+        world->update();
+        REQUIRE(added.size() == 1);
+        REQUIRE(!entity.has<observed_component>());
+        REQUIRE(removed == std::vector<saturn::entity_id> {entity.id()});
+    }
+}
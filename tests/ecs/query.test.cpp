@@ -14,6 +14,22 @@ struct test_component_c {
     int c;
 };
 
+struct test_tag {};
+
+struct alignas(32) test_component_aligned {
+    float values[8];
+};
+
+template <int N>
+struct test_numbered_component {
+    int value;
+};
+
+template <int... N>
+void set_numbered_components(saturn::entity entity, std::integer_sequence<int, N...>) {
+    (entity.set<test_numbered_component<N>>({N}), ...);
+}
+
 TEST_CASE("query", "[ecs]") {
     auto universe = saturn::universe::create();
     auto world = universe->create_world();
@@ -29,6 +45,290 @@ TEST_CASE("query", "[ecs]") {
         REQUIRE(query.count() == 0);
     }
 
+    SECTION("query created before its archetypes exist") {
+        auto query = world->create_query<test_component_a>();
+        auto entity_1 = world->create_entity();
+        entity_1.set<test_component_a>({1});
+        auto entity_2 = world->create_entity();
+        entity_2.set<test_component_b>({2});
+        entity_2.set<test_component_a>({2});
+        REQUIRE(query.count() == 2);
+
+        int sum = 0;
+        for (const auto& [entity, component_a] : query)
+            sum += component_a.a;
+        REQUIRE(sum == 3);
+    }
+
+    SECTION("queries with the same components in a different order") {
+        auto entity = world->create_entity();
+        entity.set<test_component_a>({1});
+        entity.set<test_component_b>({2});
+        auto query_ab = world->create_query<test_component_a, test_component_b>();
+        auto query_ba = world->create_query<test_component_b, test_component_a>();
+        for (const auto& [_, component_a, component_b] : query_ab) {
+            REQUIRE(component_a.a == 1);
+            REQUIRE(component_b.b == 2);
+        }
+        for (const auto& [_, component_b, component_a] : query_ba) {
+            REQUIRE(component_a.a == 1);
+            REQUIRE(component_b.b == 2);
+        }
+    }
+
+    SECTION("query entities spanning multiple chunks") {
+        std::vector<saturn::entity> entities;
+        for (int i = 0; i < 10000; i++) {
+            auto entity = world->create_entity();
+            entity.set<test_component_a>({i});
+            entity.set<test_component_b>({-i});
+            entities.push_back(entity);
+        }
+        for (int i = 0; i < 10000; i += 3)
+            world->destroy_entity(entities[i]);
+
+        auto query = world->create_query<test_component_a, test_component_b>();
+        REQUIRE(query.count() == 6666);
+
+        size_t count = 0;
+        for (const auto& [entity, component_a, component_b] : query) {
+            REQUIRE(component_a.a % 3 != 0);
+            REQUIRE(component_a.a == -component_b.b);
+            REQUIRE(&component_a == &*entity.get<test_component_a>().get());
+            count++;
+        }
+        REQUIRE(count == 6666);
+    }
+
+    SECTION("query components with extended alignment") {
+        for (int i = 0; i < 1000; i++) {
+            auto entity = world->create_entity();
+            entity.set<test_component_c>({i});
+            entity.set<test_component_aligned>({});
+        }
+
+        auto query = world->create_query<test_component_c, test_component_aligned>();
+        for (const auto& [entity, component_c, component_aligned] : query) {
+            REQUIRE((uintptr_t) &component_c % alignof(test_component_c) == 0);
+            REQUIRE((uintptr_t) &component_aligned % 32 == 0);
+            if (component_c.c == 0) REQUIRE((uintptr_t) &component_c % SATURN_ECS_COLUMN_ALIGNMENT == 0);
+        }
+    }
+
+    SECTION("query tag components") {
+        for (int i = 0; i < 10; i++) {
+            auto entity = world->create_entity();
+            entity.set<test_component_a>({i});
+            if (i % 2 == 0) entity.add<test_tag>();
+        }
+
+        auto query = world->create_query<test_component_a, test_tag>();
+        REQUIRE(query.count() == 5);
+        for (const auto& [entity, component_a, tag] : query) {
+            static_assert(std::is_same_v<decltype(tag), const test_tag>);
+            REQUIRE(component_a.a % 2 == 0);
+            REQUIRE(&component_a == &*entity.get<test_component_a>().get());
+        }
+    }
+
+    SECTION("query in parallel") {
+        saturn::world parallel_world(saturn::component_registry::create(), saturn::thread_pool::create(4));
+        for (int i = 0; i < 20000; i++) {
+            auto entity = parallel_world.create_entity();
+            entity.set<test_component_a>({i});
+            if (i % 2 == 0) entity.set<test_component_b>({0});
+            if (i % 5 == 0) entity.add<test_tag>();
+        }
+
+        auto query = parallel_world.create_query<test_component_a, test_component_b, test_tag>();
+        query.par_each([](const saturn::entity& entity, test_component_a& a, test_component_b& b, test_tag tag) {
+            b.b = a.a * 2;
+        });
+        size_t count = 0;
+        for (const auto& [entity, a, b, tag] : query) {
+            REQUIRE(b.b == a.a * 2);
+            count++;
+        }
+        REQUIRE(count == 2000);
+
+        auto all = parallel_world.create_query<const test_component_a>();
+        int64_t sum = all.par_reduce(
+            int64_t(0), [](int64_t& sum, const saturn::entity& entity, const test_component_a& a) { sum += a.a; },
+            [](int64_t& sum, int64_t worker_sum) { sum += worker_sum; });
+        REQUIRE(sum == int64_t(20000) * 19999 / 2);
+
+        std::vector<std::atomic<int>> visits(20000);
+        all.par_each([&](const saturn::entity& entity, const test_component_a& a) { visits[a.a]++; });
+        for (auto& visit : visits)
+            REQUIRE(visit == 1);
+
+        REQUIRE_THROWS(all.par_each([](const saturn::entity& entity, const test_component_a& a) {
+            if (a.a == 12345) throw std::runtime_error("failed");
+        }));
+    }
+
+    SECTION("query chunks") {
+        std::vector<saturn::entity> entities;
+        for (int i = 0; i < 10000; i++) {
+            auto entity = world->create_entity();
+            entity.set<test_component_a>({i});
+            entity.set<test_component_b>({0});
+            if (i % 2 == 0) entity.add<test_tag>();
+            entities.push_back(entity);
+        }
+
+        auto query = world->create_query<const test_component_a, test_component_b, test_tag>();
+        size_t rows = 0;
+        query.each_chunk([&](const saturn::query_chunk<const test_component_a, test_component_b, test_tag>& chunk) {
+            auto a = chunk.components<test_component_a>();
+            auto b = chunk.components<1>();
+            static_assert(std::is_same_v<decltype(a), std::span<const test_component_a>>);
+            static_assert(std::is_same_v<decltype(b), std::span<test_component_b>>);
+            REQUIRE(chunk.size() > 0);
+            REQUIRE(a.size() == chunk.size());
+            REQUIRE(chunk.entities().size() == chunk.size());
+            for (size_t i = 0; i < chunk.size(); i++)
+                b[i].b = a[i].a + 1;
+            for (size_t i = 0; i < chunk.size(); i++)
+                REQUIRE(saturn::_::entity_id_index(chunk.entities()[i]) == (uint32_t) a[i].a);
+            rows += chunk.size();
+        });
+        REQUIRE(rows == 5000);
+
+        std::atomic<size_t> parallel_rows = 0;
+        query.par_each_chunk([&](const auto& chunk) { parallel_rows += chunk.size(); });
+        REQUIRE(parallel_rows == 5000);
+
+        for (int i = 0; i < 10000; i++)
+            REQUIRE(entities[i].get<test_component_b>().get()->b == (i % 2 == 0 ? i + 1 : 0));
+    }
+
+    SECTION("query with filters and optional components") {
+        for (int i = 0; i < 12; i++) {
+            auto entity = world->create_entity();
+            entity.set<test_component_a>({i});
+            if (i % 2 == 0) entity.set<test_component_b>({i * 10});
+            if (i % 3 == 0) entity.add<test_tag>();
+        }
+
+        auto without_tag = world->create_query<test_component_a, saturn::without<test_tag>>();
+        REQUIRE(without_tag.count() == 8);
+        for (const auto& [entity, a] : without_tag)
+            REQUIRE(a.a % 3 != 0);
+
+        auto with_b = world->create_query<saturn::with<test_component_b>, const test_component_a>();
+        REQUIRE(with_b.count() == 6);
+        for (const auto& [entity, a] : with_b) {
+            static_assert(std::is_same_v<decltype(a), const test_component_a&>);
+            REQUIRE(a.a % 2 == 0);
+        }
+
+        auto optional = world->create_query<test_component_a, test_component_b*, const test_tag*>();
+        REQUIRE(optional.count() == 12);
+        for (const auto& [entity, a, b, tag] : optional) {
+            static_assert(std::is_same_v<decltype(b), test_component_b* const>);
+            REQUIRE((b != nullptr) == (a.a % 2 == 0));
+            REQUIRE((tag != nullptr) == (a.a % 3 == 0));
+            if (b) REQUIRE(b->b == a.a * 10);
+        }
+
+        auto filtered = world->create_query<test_component_a, test_component_b*, saturn::without<test_tag>>();
+        REQUIRE(filtered.count() == 8);
+        int sum = filtered.par_reduce(
+            0, [](int& sum, const saturn::entity& entity, test_component_a& a, test_component_b* b) {
+                if (b) sum += b->b;
+            },
+            [](int& sum, int worker_sum) { sum += worker_sum; });
+        REQUIRE(sum == (20 + 40 + 80 + 100));
+
+        size_t rows = 0;
+        filtered.each_chunk([&](const auto& chunk) {
+            auto b = chunk.template components<test_component_b>();
+            REQUIRE((b.empty() || b.size() == chunk.size()));
+            rows += chunk.size();
+        });
+        REQUIRE(rows == 8);
+
+        // Archetypes created after the query are filtered too
+        auto entity = world->create_entity();
+        entity.set<test_component_a>({100});
+        entity.set<test_component_c>({0});
+        REQUIRE(without_tag.count() == 9);
+        entity.add<test_tag>();
+        REQUIRE(without_tag.count() == 8);
+    }
+
+    SECTION("query changed and added components") {
+        auto entities = world->create_entities<test_component_a>(10000, {0});
+        auto changed = world->create_query<const test_component_a, saturn::changed<test_component_a>>();
+        auto added = world->create_query<saturn::added<test_component_b>>();
+        auto writer = world->create_query<test_component_a>();
+
+        // Everything counts as changed on the first run
+        REQUIRE(changed.count() == 10000);
+        size_t rows = 0;
+        for (const auto& [entity, a] : changed)
+            rows++;
+        REQUIRE(rows == 10000);
+        REQUIRE(changed.count() == 0);
+        REQUIRE(changed.begin() == changed.end());
+
+        // Only the chunk that was written to is matched again
+        entities[0].set<test_component_a>({1});
+        REQUIRE(changed.count() > 0);
+        REQUIRE(changed.count() < 10000);
+        rows = 0;
+        bool seen = false;
+        changed.each_chunk([&](const auto& chunk) {
+            rows += chunk.size();
+            for (auto id : chunk.entities())
+                seen |= id == entities[0].id();
+        });
+        REQUIRE(seen);
+        REQUIRE(rows < 10000);
+        REQUIRE(changed.count() == 0);
+
+        // Mutable access through a component counts as a write
+        entities[5000].get<test_component_a>().get()->a = 2;
+        REQUIRE(changed.count() > 0);
+        for (const auto& [entity, a] : changed) { }
+        REQUIRE(changed.count() == 0);
+
+        // A query fetching T mutably writes to every chunk it visits, but doesn't see its own writes
+        for (const auto& [entity, a] : writer)
+            a.a++;
+        REQUIRE(changed.count() == 10000);
+        for (const auto& [entity, a] : writer) { }
+        REQUIRE(writer.count() == 10000);
+
+        // Additions are tracked separately from changes
+        for (const auto& [entity] : added) { }
+        entities[9999].add<test_component_b>();
+        REQUIRE(added.count() == 1);
+        for (const auto& [entity] : added)
+            REQUIRE(entity == entities[9999]);
+        entities[9999].set<test_component_b>({1});
+        REQUIRE(added.count() == 0);
+    }
+
+    SECTION("query more than 64 component types") {
+        auto entity_1 = world->create_entity();
+        set_numbered_components(entity_1, std::make_integer_sequence<int, 100>());
+        auto entity_2 = world->create_entity();
+        entity_2.set<test_numbered_component<99>>({99});
+
+        auto query = world->create_query<test_numbered_component<0>, test_numbered_component<70>,
+                                         test_numbered_component<99>>();
+        REQUIRE(query.count() == 1);
+        for (const auto& [entity, component_0, component_70, component_99] : query) {
+            REQUIRE(entity == entity_1);
+            REQUIRE(component_0.value == 0);
+            REQUIRE(component_70.value == 70);
+            REQUIRE(component_99.value == 99);
+        }
+        REQUIRE(world->create_query<test_numbered_component<99>>().count() == 2);
+    }
+
     SECTION("add entities to the world") {
         std::unordered_map<saturn::entity_id, saturn::entity> entities;
         for (int i = 0; i < 10; i++) {
@@ -134,6 +434,20 @@ TEST_CASE("query", "[ecs]") {
             }
         }
 
+        SECTION("query after destroying some entities") {
+            for (auto& [_, entity] : entities) {
+                if (entity.has<test_component_a>() && entity.get<test_component_a>().get()->a % 4 == 0)
+                    world->destroy_entity(entity);
+            }
+            auto query = world->create_query<test_component_a>();
+            REQUIRE(query.count() == 2);
+            for (const auto& [entity, component_a] : query) {
+                REQUIRE(entity.alive());
+                REQUIRE(component_a.a % 4 == 2);
+                REQUIRE(&component_a == &*entity.get<test_component_a>().get());
+            }
+        }
+
         SECTION("query for destroyed entities") {
             for (auto& [_, entity] : entities)
                 world->destroy_entity(entity);
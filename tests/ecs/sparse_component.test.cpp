@@ -0,0 +1,171 @@
+#include <catch2/catch_test_macros.hpp>
+#include <saturn/saturn.h>
+#include <string>
+
+struct sparse_position {
+    float x, y;
+};
+
+struct status_effect {
+    std::string name;
+    int turns;
+};
+
+struct stunned {};
+
+struct never_added {
+    int value;
+};
+
+template <>
+struct saturn::sparse_component<status_effect> : std::true_type { };
+
+template <>
+struct saturn::sparse_component<stunned> : std::true_type { };
+
+template <>
+struct saturn::sparse_component<never_added> : std::true_type { };
+
+TEST_CASE("sparse components", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+
+    std::vector<saturn::entity> entities;
+    for (int i = 0; i < 100; i++) {
+        auto entity = world->create_entity();
+        entity.set<sparse_position>({(float) i, (float) -i});
+        entities.push_back(entity);
+    }
+
+    SECTION("adding and removing doesn't move the entity") {
+        sparse_position* position = entities[0].try_get<sparse_position>();
+        REQUIRE(entities[0].add<status_effect>("poison", 3).is_ok());
+        REQUIRE(entities[0].add<status_effect>("burn", 1).is_err());
+        REQUIRE(entities[0].set<stunned>({}).is_ok());
+        REQUIRE(entities[0].try_get<sparse_position>() == position);
+        REQUIRE(entities[0].has<status_effect>());
+        REQUIRE(entities[0].has<stunned>());
+        REQUIRE(entities[0].get<status_effect>().get()->name == "poison");
+
+        entities[0].set<status_effect>({"burn", 1});
+        REQUIRE(entities[0].try_get<status_effect>()->name == "burn");
+
+        entities[0].remove<status_effect, stunned>();
+        REQUIRE_FALSE(entities[0].has<status_effect>());
+        REQUIRE_FALSE(entities[0].has<stunned>());
+        REQUIRE(entities[0].try_get<status_effect>() == nullptr);
+        REQUIRE(entities[0].get<status_effect>().is_err());
+        REQUIRE(entities[0].try_get<sparse_position>() == position);
+    }
+
+    SECTION("removing keeps the other components intact") {
+        for (int i = 0; i < 100; i++)
+            entities[i].set<status_effect>({std::to_string(i), i});
+        auto effect = entities[98].get<status_effect>().get();
+        for (int i = 0; i < 100; i += 3)
+            entities[i].remove<status_effect>();
+
+        // The last component is relocated into the freed slot, handles find it again
+        REQUIRE(effect->turns == 98);
+        for (int i = 0; i < 100; i++) {
+            REQUIRE(entities[i].has<status_effect>() == (i % 3 != 0));
+            if (i % 3 != 0) REQUIRE(entities[i].get<status_effect>().get()->name == std::to_string(i));
+        }
+    }
+
+    SECTION("queries join sparse and archetype components") {
+        for (int i = 0; i < 100; i += 4)
+            entities[i].set<status_effect>({"poison", i});
+        for (int i = 0; i < 100; i += 5)
+            entities[i].set<stunned>({});
+
+        auto query = world->create_query<sparse_position, status_effect>();
+        REQUIRE(query.count() == 25);
+        int seen = 0;
+        for (auto [entity, position, effect] : query) {
+            REQUIRE(position.x == (float) effect.turns);
+            effect.turns++;
+            seen++;
+        }
+        REQUIRE(seen == 25);
+        REQUIRE(entities[4].get<status_effect>().get()->turns == 5);
+
+        REQUIRE(world->create_query<saturn::with<status_effect>, stunned>().count() == 5);
+        REQUIRE(world->create_query<sparse_position, saturn::without<status_effect>>().count() == 75);
+
+        int optional = 0;
+        for (auto [entity, position, effect] : world->create_query<sparse_position, status_effect*>()) {
+            REQUIRE((effect != nullptr) == ((int) position.x % 4 == 0));
+            optional++;
+        }
+        REQUIRE(optional == 100);
+
+        std::atomic<int> stunned_count = 0;
+        world->create_query<stunned, sparse_position>().par_each([&](const saturn::entity& entity, stunned, auto&) {
+            stunned_count++;
+        });
+        REQUIRE(stunned_count == 20);
+
+        // Nothing has ever had the component, so there is no sparse set yet
+        REQUIRE(world->create_query<sparse_position, never_added*>().count() == 100);
+        REQUIRE(world->create_query<sparse_position, saturn::without<never_added>>().count() == 100);
+    }
+
+    SECTION("destroying an entity destroys its sparse components") {
+        entities[0].set<status_effect>({"poison", 3});
+        world->destroy_entity(entities[0]);
+        REQUIRE(world->create_query<status_effect>().count() == 0);
+
+        // The entity index is reused by the next entity
+        auto entity = world->create_entity();
+        REQUIRE_FALSE(entity.has<status_effect>());
+    }
+
+    SECTION("created entities and commands") {
+        auto created = world->create_entities(10, sparse_position {1, 1}, status_effect {"regen", 5});
+        REQUIRE(created[0].get<status_effect>().get()->name == "regen");
+        REQUIRE(created[0].get<sparse_position>().get()->x == 1);
+
+        world->create_system<sparse_position>([&](auto& ctx, auto& query) {
+            for (auto [entity, position] : query) {
+                if (entity.template has<status_effect>()) {
+                    ctx.commands().template remove<status_effect>(entity);
+                } else {
+                    ctx.commands().set(entity, status_effect {"slow", 2});
+                    ctx.commands().set(entity, stunned {});
+                }
+            }
+            ctx.commands().create_entity(status_effect {"haste", 1});
+        });
+        world->update();
+        for (auto& entity : entities) {
+            REQUIRE(entity.get<status_effect>().get()->name == "slow");
+            REQUIRE(entity.has<stunned>());
+        }
+        for (auto& entity : created)
+            REQUIRE_FALSE(entity.has<status_effect>());
+        REQUIRE(world->create_query<status_effect, saturn::without<sparse_position>>().count() == 1);
+    }
+
+    SECTION("observers see sparse components") {
+        std::vector<saturn::entity_id> added;
+        std::vector<saturn::entity_id> removed;
+        world->create_observer<status_effect>(saturn::observer_event::added,
+                                              [&](std::span<const saturn::entity> batch) {
+                                                  for (const auto& entity : batch)
+                                                      added.push_back(entity.id());
+                                              });
+        world->create_observer<status_effect>(saturn::observer_event::removed,
+                                              [&](std::span<const saturn::entity> batch) {
+                                                  for (const auto& entity : batch)
+                                                      removed.push_back(entity.id());
+                                              });
+        entities[0].set<status_effect>({"poison", 3});
+        entities[0].set<status_effect>({"burn", 3});
+        entities[1].set<status_effect>({"poison", 3});
+        entities[1].remove<status_effect>();
+        world->update();
+        REQUIRE(added == std::vector<saturn::entity_id> {entities[0].id(), entities[1].id()});
+        REQUIRE(removed == std::vector<saturn::entity_id> {entities[1].id()});
+    }
+}
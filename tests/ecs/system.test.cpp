@@ -161,3 +161,357 @@ TEST_CASE("system", "[ecs]") {
         world->destroy_system(0);
     }
 }
+
+struct command_name {
+    std::string name;
+};
+
+struct command_tag {};
+
+TEST_CASE("command buffer", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+
+    std::vector<saturn::entity> entities;
+    for (int i = 0; i < 10; i++) {
+        auto entity = world->create_entity();
+        entity.set<component_a>({i});
+        if (i % 2 == 0) entity.set<component_b>({i});
+        entities.push_back(entity);
+    }
+
+    SECTION("changes are applied after the stage") {
+        int seen = 0;
+        world->create_system<component_a>([&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query) {
+                seen++;
+                ctx.commands().template set<component_c>(entity, {a.a});
+                ctx.commands().template remove<component_a>(entity);
+            }
+            REQUIRE(query.count() == 10);
+        });
+        world->update();
+        REQUIRE(seen == 10);
+        for (int i = 0; i < 10; i++) {
+            REQUIRE_FALSE(entities[i].has<component_a>());
+            REQUIRE(entities[i].get<component_c>().get()->c == i);
+            REQUIRE(entities[i].has<component_b>() == (i % 2 == 0));
+        }
+        REQUIRE(world->create_query<component_a>().count() == 0);
+    }
+
+    SECTION("later stages see the changes") {
+        int seen = 0;
+        world->create_system<component_a>(saturn::stages::pre_update, [&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query)
+                ctx.commands().set(entity, component_c {a.a * 2});
+        });
+        world->create_system<component_c>(saturn::stages::update, [&](auto& query) {
+            for (auto [entity, c] : query) {
+                REQUIRE(c.c == entity.template get<component_a>().get()->a * 2);
+                seen++;
+            }
+        });
+        world->update();
+        REQUIRE(seen == 10);
+    }
+
+    SECTION("create and destroy entities") {
+        world->create_system<component_b>([&](auto& ctx, auto& query) {
+            for (auto [entity, b] : query) {
+                ctx.commands().destroy_entity(entity);
+                ctx.commands().create_entity(component_a {b.b + 100}, component_c {b.b}, command_tag {});
+            }
+            ctx.commands().create_entity();
+        });
+        world->update();
+        for (int i = 0; i < 10; i++)
+            REQUIRE(entities[i].alive() == (i % 2 != 0));
+
+        int created = 0;
+        for (auto [entity, a, c, tag] : world->create_query<component_a, component_c, command_tag>()) {
+            REQUIRE(a.a == c.c + 100);
+            REQUIRE(!entity.has<component_b>());
+            created++;
+        }
+        REQUIRE(created == 5);
+        REQUIRE(world->create_query<>().count() == 11);
+    }
+
+    SECTION("commands for the same entity are merged in order") {
+        world->create_system<component_a>([&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query) {
+                ctx.commands().set(entity, component_c {1});
+                ctx.commands().template remove<component_c>(entity);
+                ctx.commands().template remove<component_a, component_b>(entity);
+                ctx.commands().set(entity, component_b {2});
+                ctx.commands().set(entity, component_b {3});
+                ctx.commands().set(entity, command_name {"entity"});
+            }
+        });
+        world->update();
+        for (auto& entity : entities) {
+            REQUIRE_FALSE(entity.has<component_a>());
+            REQUIRE_FALSE(entity.has<component_c>());
+            REQUIRE(entity.get<component_b>().get()->b == 3);
+            REQUIRE(entity.get<command_name>().get()->name == "entity");
+        }
+    }
+
+    SECTION("commands for destroyed entities are dropped") {
+        world->create_system<component_a>([&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query) {
+                ctx.commands().set(entity, command_name {std::string(64, 'x')});
+                ctx.commands().destroy_entity(entity);
+                ctx.commands().set(entity, component_c {a.a});
+            }
+        });
+        world->update();
+        for (auto& entity : entities)
+            REQUIRE(entity.dead());
+        REQUIRE(world->create_query<>().count() == 0);
+    }
+
+    SECTION("destroy a parent and edit its child in the same buffer") {
+        for (int i = 0; i < 10; i += 2)
+            entities[i].set_parent(entities[i + 1]);
+        world->create_system<const component_a>([&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query) {
+                if (entity.template has<component_b>()) ctx.commands().set(entity, component_c {a.a});
+                else ctx.commands().destroy_entity(entity);
+            }
+        });
+        world->update();
+        for (auto& entity : entities)
+            REQUIRE(entity.dead());
+        REQUIRE(world->create_query<>().count() == 0);
+    }
+
+    SECTION("record commands from parallel queries") {
+        world->create_system<component_a>([&](auto& ctx, auto& query) {
+            query.par_each([&](const saturn::entity& entity, component_a& a) {
+                if (a.a % 2 == 0) ctx.commands().template remove<component_a>(entity);
+                else ctx.commands().set(entity, command_name {std::to_string(a.a)});
+            });
+        });
+        world->update();
+        for (int i = 0; i < 10; i++) {
+            REQUIRE(entities[i].has<component_a>() == (i % 2 != 0));
+            REQUIRE(entities[i].has<command_name>() == (i % 2 != 0));
+        }
+    }
+
+    SECTION("buffers are reused across updates") {
+        int updates = 0;
+        world->create_system<component_a>([&](auto& ctx, auto& query) {
+            for (auto [entity, a] : query)
+                ctx.commands().set(entity, command_name {std::to_string(a.a + updates)});
+            updates++;
+        });
+        for (int i = 0; i < 3; i++)
+            world->update();
+        for (int i = 0; i < 10; i++)
+            REQUIRE(entities[i].get<command_name>().get()->name == std::to_string(i + 2));
+    }
+}
+
+struct scheduled_marker {
+    int value;
+};
+
+TEST_CASE("system scheduling", "[ecs]") {
+    saturn::world world(saturn::component_registry::create(), saturn::thread_pool::create(4));
+
+    std::vector<saturn::entity> entities;
+    for (int i = 0; i < 1000; i++) {
+        auto entity = world.create_entity();
+        entity.set<component_a>({i});
+        entity.set<component_b>({0});
+        entity.set<component_c>({0});
+        entities.push_back(entity);
+    }
+
+    SECTION("systems writing the same component run in creation order") {
+        world.create_system<component_a>([](auto& query) {
+            for (auto [entity, a] : query)
+                a.a *= 2;
+        });
+        world.create_system<component_a>([](auto& query) {
+            for (auto [entity, a] : query)
+                a.a += 1;
+        });
+        world.update();
+        for (int i = 0; i < 1000; i++)
+            REQUIRE(entities[i].get<component_a>().get()->a == i * 2 + 1);
+    }
+
+    SECTION("systems reading a component run after earlier systems writing it") {
+        world.create_system<const component_a, component_b>([](auto& query) {
+            for (auto [entity, a, b] : query)
+                b.b = a.a + 1;
+        });
+        world.create_system<const component_b, component_c>([](auto& query) {
+            for (auto [entity, b, c] : query)
+                c.c = b.b * 2;
+        });
+        world.update();
+        for (int i = 0; i < 1000; i++)
+            REQUIRE(entities[i].get<component_c>().get()->c == (i + 1) * 2);
+    }
+
+    SECTION("systems without conflicts run concurrently") {
+        std::atomic<int> running = 0;
+        std::atomic<int> overlapped = 0;
+        auto wait_for_other = [&] {
+            running++;
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (running < 2 && std::chrono::steady_clock::now() < timeout)
+                std::this_thread::yield();
+            if (running == 2) overlapped++;
+        };
+        world.create_system<const component_a, component_b>([&](auto& query) { wait_for_other(); });
+        world.create_system<const component_a, component_c>([&](auto& query) { wait_for_other(); });
+        world.update();
+        REQUIRE(overlapped == 2);
+    }
+
+    SECTION("systems with no components run alone") {
+        std::atomic<int> running = 0;
+        bool overlapped = false;
+        world.create_system<component_b>([&](auto& query) {
+            running++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            running--;
+        });
+        world.create_system([&](auto& query) {
+            overlapped = running != 0;
+            REQUIRE(query.count() == 1000);
+        });
+        for (int i = 0; i < 5; i++)
+            world.update();
+        REQUIRE_FALSE(overlapped);
+    }
+
+    SECTION("exclusive systems changing the world directly run alone") {
+        std::atomic<int> running = 0;
+        bool overlapped = false;
+        world.create_system<component_b>([&](auto& query) {
+            running++;
+            for (auto [entity, b] : query)
+                b.b++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            running--;
+        });
+        world.create_system<saturn::exclusive, const component_a>([&](auto& query) {
+            overlapped = overlapped || running != 0;
+            std::vector<std::pair<saturn::entity, int>> matches;
+            for (auto [entity, a] : query)
+                matches.emplace_back(entity, a.a);
+            for (auto [entity, a] : matches) {
+                if (entity.template has<scheduled_marker>()) entity.template remove<scheduled_marker>();
+                else entity.template set<scheduled_marker>({a});
+            }
+        });
+        for (int i = 0; i < 5; i++)
+            world.update();
+        REQUIRE_FALSE(overlapped);
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE(entities[i].get<component_b>().get()->b == 5);
+            REQUIRE(entities[i].get<scheduled_marker>().get()->value == i);
+        }
+    }
+}
+
+struct game_settings {
+    int speed;
+};
+
+struct game_score {
+    int score;
+};
+
+struct resource_system
+    : public saturn::system<component_a, saturn::resource<const game_settings>, saturn::resource<game_score>> {
+    void run(ctx_t& ctx, query_t& query) override {
+        for (auto [entity, a] : query) {
+            a.a += ctx.resource<game_settings>().speed;
+            ctx.resource_mut<game_score>().score++;
+        }
+    }
+};
+
+TEST_CASE("resources", "[ecs]") {
+    saturn::world world(saturn::component_registry::create(), saturn::thread_pool::create(4));
+    for (int i = 0; i < 10; i++)
+        world.create_entity().set<component_a>({i});
+
+    SECTION("insert, replace and remove resources") {
+        REQUIRE(!world.has_resource<game_settings>());
+        REQUIRE_THROWS(world.resource<game_settings>());
+        world.insert_resource(game_settings {1});
+        REQUIRE(world.resource<game_settings>().speed == 1);
+        world.insert_resource(game_settings {2});
+        REQUIRE(world.resource<const game_settings>().speed == 2);
+        world.remove_resource<game_settings>();
+        REQUIRE(!world.has_resource<game_settings>());
+    }
+
+    SECTION("systems access the resources they declare") {
+        world.insert_resource(game_settings {3});
+        world.insert_resource(game_score {0});
+        world.create_system<resource_system>();
+        world.update();
+        REQUIRE(world.resource<game_score>().score == 10);
+        int sum = 0;
+        for (auto [entity, a] : world.create_query<const component_a>())
+            sum += a.a;
+        REQUIRE(sum == 45 + 10 * 3);
+    }
+
+    SECTION("undeclared resources can't be accessed") {
+        world.insert_resource(game_settings {3});
+        bool read_only = false;
+        bool undeclared = false;
+        world.create_system<const component_a, saturn::resource<const game_settings>>(
+            [&](saturn::system_context& ctx, auto& query) {
+                REQUIRE(ctx.resource<game_settings>().speed == 3);
+                try {
+                    (void) ctx.resource_mut<game_settings>();
+                } catch (const std::runtime_error&) { read_only = true; }
+                try {
+                    (void) ctx.resource<game_score>();
+                } catch (const std::runtime_error&) { undeclared = true; }
+            });
+        world.update();
+        REQUIRE(read_only);
+        REQUIRE(undeclared);
+    }
+
+    SECTION("systems writing the same resource run in creation order") {
+        world.insert_resource(game_score {1});
+        world.create_system<const component_a, saturn::resource<game_score>>(
+            [](saturn::system_context& ctx, auto& query) { ctx.resource_mut<game_score>().score *= 2; });
+        world.create_system<const component_b, saturn::resource<game_score>>(
+            [](saturn::system_context& ctx, auto& query) { ctx.resource_mut<game_score>().score += 1; });
+        for (int i = 0; i < 3; i++)
+            world.update();
+        REQUIRE(world.resource<game_score>().score == 15);
+    }
+
+    SECTION("systems reading a resource run concurrently") {
+        world.insert_resource(game_settings {3});
+        std::atomic<int> running = 0;
+        std::atomic<int> overlapped = 0;
+        auto wait_for_other = [&] {
+            running++;
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (running < 2 && std::chrono::steady_clock::now() < timeout)
+                std::this_thread::yield();
+            if (running == 2) overlapped++;
+        };
+        world.create_system<saturn::resource<const game_settings>>([&](auto& query) { wait_for_other(); });
+        world.create_system<saturn::resource<const game_settings>>([&](auto& query) { wait_for_other(); });
+        world.update();
+        REQUIRE(overlapped == 2);
+    }
+}
@@ -2,6 +2,42 @@
 #include <saturn/saturn.h>
 #include <unordered_set>
 
+struct world_component_a {
+    int a;
+};
+
+struct world_component_b {
+    std::string b;
+};
+
+struct world_tag {};
+
+struct world_counted {
+    static inline int alive = 0;
+    int value;
+    explicit world_counted(int value) : value(value) {
+        alive++;
+    }
+    world_counted(const world_counted& other) : value(other.value) {
+        alive++;
+    }
+    world_counted(world_counted&& other) noexcept : value(other.value) {
+        alive++;
+    }
+    world_counted& operator=(const world_counted& other) = default;
+    world_counted& operator=(world_counted&& other) noexcept = default;
+    ~world_counted() {
+        alive--;
+    }
+};
+
+struct world_sparse_counted : world_counted {
+    using world_counted::world_counted;
+};
+
+template <>
+struct saturn::sparse_component<world_sparse_counted> : std::true_type { };
+
 TEST_CASE("world", "[ecs]") {
     auto universe = saturn::universe::create();
     auto world = universe->create_world();
@@ -62,4 +98,183 @@ TEST_CASE("world", "[ecs]") {
             world->destroy_entity(entity);
         }
     }
+
+    SECTION("create entities in bulk") {
+        auto entities = world->create_entities(1000, world_component_a {5}, world_component_b {"hello"}, world_tag {});
+        REQUIRE(entities.size() == 1000);
+
+        std::unordered_set<saturn::entity_id> ids = {};
+        for (auto& entity : entities) {
+            REQUIRE(entity.alive());
+            REQUIRE(entity.has<world_tag>());
+            REQUIRE(entity.get<world_component_a>().get()->a == 5);
+            REQUIRE(entity.get<world_component_b>().get()->b == "hello");
+            REQUIRE(!ids.contains(entity.id()));
+            ids.insert(entity.id());
+        }
+        REQUIRE(world->create_query<world_component_a, world_component_b>().count() == 1000);
+    }
+
+    SECTION("create entities in bulk reusing destroyed entities") {
+        auto entity = world->create_entity();
+        world->destroy_entity(entity);
+        auto entities = world->create_entities(2, world_component_a {1});
+        REQUIRE(saturn::_::entity_id_index(entities[0].id()) == saturn::_::entity_id_index(entity.id()));
+        REQUIRE(entities[0].alive());
+        REQUIRE(entities[1].alive());
+        REQUIRE(!entity.alive());
+    }
+
+    SECTION("reserve entities then create them") {
+        world->reserve<world_component_a>(100);
+        auto entities = world->create_entities(100, world_component_a {3});
+        for (auto& entity : entities)
+            REQUIRE(entity.get<world_component_a>().get()->a == 3);
+    }
+}
+
+TEST_CASE("compaction", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+    auto entities = world->create_entities(1000, world_component_a {1}, world_component_b {"hello"});
+    auto survivor = entities[10];
+    for (auto& entity : entities) {
+        if (entity != survivor) world->destroy_entity(entity);
+    }
+    world_component_b* survivor_b = survivor.try_get<world_component_b>();
+
+    SECTION("components survive compaction in place") {
+        world->compact();
+        REQUIRE(survivor.try_get<world_component_b>() == survivor_b);
+        REQUIRE(survivor_b->b == "hello");
+        REQUIRE(world->create_query<world_component_a, world_component_b>().count() == 1);
+
+        // Freed storage is allocated again as entities come back
+        auto created = world->create_entities(1000, world_component_a {2}, world_component_b {"again"});
+        REQUIRE(world->create_query<world_component_a, world_component_b>().count() == 1001);
+        REQUIRE(created.back().get<world_component_b>().get()->b == "again");
+        REQUIRE(survivor.try_get<world_component_b>() == survivor_b);
+    }
+
+    SECTION("compact empty archetypes and sparse sets") {
+        auto entity = world->create_entity();
+        entity.set<world_component_a>({3});
+        entity.set<world_sparse_counted>(world_sparse_counted {4});
+        entity.remove<world_component_a, world_sparse_counted>();
+        world->compact();
+        REQUIRE(world_counted::alive == 0);
+
+        entity.set<world_component_a>({5});
+        entity.set<world_sparse_counted>(world_sparse_counted {6});
+        REQUIRE(entity.get<world_component_a>().get()->a == 5);
+        REQUIRE(entity.get<world_sparse_counted>().get()->value == 6);
+        world->destroy_entity(entity);
+        REQUIRE(world_counted::alive == 0);
+    }
+
+    SECTION("compact incrementally during updates") {
+        world->set_compaction_budget(1);
+        for (int i = 0; i < 10; i++) {
+            auto batch = world->create_entities(500, world_component_a {i});
+            world->update();
+            for (auto& entity : batch)
+                world->destroy_entity(entity);
+            world->update();
+        }
+        REQUIRE(world->create_query<world_component_a>().count() == 1);
+        REQUIRE(survivor.try_get<world_component_b>() == survivor_b);
+    }
+
+    SECTION("destroying the world destroys every component") {
+        world->create_entities(100, world_counted {1}, world_sparse_counted {2});
+        world->compact();
+        REQUIRE(world_counted::alive == 200);
+        world.reset();
+        REQUIRE(world_counted::alive == 0);
+    }
+}
+
+TEST_CASE("hierarchy", "[ecs]") {
+    auto universe = saturn::universe::create();
+    auto world = universe->create_world();
+
+    auto root = world->create_entity();
+    auto child_1 = world->create_entity();
+    auto child_2 = world->create_entity();
+    auto grandchild = world->create_entity();
+    child_1.set_parent(root);
+    child_2.set_parent(root);
+    grandchild.set_parent(child_1);
+
+    SECTION("parent and children") {
+        REQUIRE(root.parent().dead());
+        REQUIRE(child_1.parent() == root);
+        REQUIRE(grandchild.parent() == child_1);
+        REQUIRE(root.children() == std::vector<saturn::entity> {child_1, child_2});
+        REQUIRE(child_2.children().empty());
+    }
+
+    SECTION("reparent an entity") {
+        grandchild.set_parent(child_2);
+        REQUIRE(child_1.children().empty());
+        REQUIRE(child_2.children() == std::vector<saturn::entity> {grandchild});
+        child_1.remove_parent();
+        REQUIRE(child_1.parent().dead());
+        REQUIRE(root.children() == std::vector<saturn::entity> {child_2});
+    }
+
+    SECTION("parent can't be a descendant") {
+        REQUIRE_THROWS(root.set_parent(grandchild));
+        REQUIRE_THROWS(root.set_parent(root));
+        REQUIRE(root.parent().dead());
+    }
+
+    SECTION("destroying an entity destroys its descendants") {
+        world->destroy_entity(child_1);
+        REQUIRE(!child_1.alive());
+        REQUIRE(!grandchild.alive());
+        REQUIRE(root.children() == std::vector<saturn::entity> {child_2});
+
+        // Recycled entities start without a hierarchy
+        auto entity = world->create_entity();
+        REQUIRE(entity.parent().dead());
+        REQUIRE(entity.children().empty());
+    }
+
+    SECTION("propagate values down the hierarchy") {
+        for (auto entity : {root, child_1, child_2, grandchild})
+            entity.set<world_component_a>({1});
+        world->propagate<world_component_a>(
+            [](const saturn::entity& entity, world_component_a& a, const world_component_a& parent_a) {
+                a.a += parent_a.a;
+            });
+        REQUIRE(root.get<world_component_a>().get()->a == 1);
+        REQUIRE(child_1.get<world_component_a>().get()->a == 2);
+        REQUIRE(child_2.get<world_component_a>().get()->a == 2);
+        REQUIRE(grandchild.get<world_component_a>().get()->a == 3);
+
+        // Entities whose parent lacks the component are skipped
+        child_1.remove<world_component_a>();
+        world->propagate<world_component_a>(
+            [](const saturn::entity& entity, world_component_a& a, const world_component_a& parent_a) { a.a = 0; });
+        REQUIRE(child_2.get<world_component_a>().get()->a == 0);
+        REQUIRE(grandchild.get<world_component_a>().get()->a == 3);
+    }
+
+    SECTION("propagate through a deep and wide hierarchy") {
+        saturn::world parallel_world(saturn::component_registry::create(), saturn::thread_pool::create(4));
+        auto entities = parallel_world.create_entities<world_component_a>(10000, {1});
+        for (size_t i = 1; i < entities.size(); i++)
+            entities[i].set_parent(entities[(i - 1) / 4]);
+        parallel_world.propagate<world_component_a>(
+            [](const saturn::entity& entity, world_component_a& a, const world_component_a& parent_a) {
+                a.a = parent_a.a + 1;
+            });
+        for (size_t i = 0; i < entities.size(); i++) {
+            int depth = 1;
+            for (size_t j = i; j > 0; j = (j - 1) / 4)
+                depth++;
+            REQUIRE(entities[i].get<world_component_a>().get()->a == depth);
+        }
+    }
 }